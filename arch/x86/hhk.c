@@ -2,6 +2,10 @@
 #include <arch/x86/idt.h>
 #include <awa/mm/page.h>
 #include <awa/common.h>
+#include <awa/spike.h>
+#include <hal/cpu.h>
+
+#include <cpuid.h>
 
 /*
         PTD(页目录) = PD(页目录)
@@ -110,16 +114,97 @@ SET_PTE--|    /
 // use table #5
 #define PG_TABLE_STACK              4
 
+// boot.S 中为 mb_info 预留的空间，_save_multiboot_info 保存的内容不能超过它
+#define MB_INFO_SIZE                4096
+
 // Provided by linker (see linker.ld)
 extern uint8_t __kernel_start;
 extern uint8_t __kernel_end;
 extern uint8_t __init_hhk_end;
 extern uint8_t _k_stack;
 
+#ifndef CONFIG_PAE
+// 处理器是否支持 4MiB 大页（CPUID.01H:EDX.PSE[bit 3]）
+static int
+_has_pse() {
+    reg32 eax = 0, ebx = 0, ecx = 0, edx = 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+    return edx & (1 << 3);
+}
+#endif
+
+// 处理器支持全局页（CPUID.01H:EDX.PGE[bit 13]）时开启 CR4.PGE，返回内核映射应带上的 PG_GLOBAL。
+// 对等映射与递归映射不是全局的：前者之后会被解除，后者每个地址空间各不相同
+static uint32_t
+_enable_global_pages() {
+    reg32 eax = 0, ebx = 0, ecx = 0, edx = 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & (1 << 13))) {
+        return 0;
+    }
+    cpu_lcr4(cpu_rcr4() | CR4_PGE);
+    return PG_GLOBAL;
+}
+
+// 用大页将物理 [0, 内核结束处) 线性地映射至 HIGHER_HLF_BASE（按大页向上取整），
+//  既不需要内核的页表，也只占用几个 TLB 项。dirs 为（连在一起的）页目录
+static void
+_map_kernel_large(x86_pte_t* dirs, uint32_t global) {
+    uint32_t base = L1_INDEX(HIGHER_HLF_BASE);
+    uint32_t count = CEIL(V2P(&__kernel_end), PG_LARGE_SIZE_BITS);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        dirs[base + i] = NEW_L1_ENTRY(PG_PREM_RW | PG_PDE_4MB | global, i << PG_LARGE_SIZE_BITS);
+    }
+}
+
+#ifdef CONFIG_PAE
+//-----------------------------PAE：kpg 中各个表的页序号
+#define PG_PAE_PDPT                 0   // 页目录指针表（PDPT）
+#define PG_PAE_DIRS                 1   // 四个页目录，连续存放，即一张 2048 项的一级页表
+#define PG_PAE_IDENTITY             5   // 对等映射低 2MiB
+
+// kpg 中第 i 页的表
+#define PAE_TABLE(kpg, i)           ((x86_pte_t*)((uint8_t*)(kpg) + ((i) << PG_SIZE_BITS)))
+
+void
+_init_page(ptd_t* ptd) {
+    x86_pte_t* pdpt = PAE_TABLE(ptd, PG_PAE_PDPT);
+    x86_pte_t* dirs = PAE_TABLE(ptd, PG_PAE_DIRS);
+    x86_pte_t* identity = PAE_TABLE(ptd, PG_PAE_IDENTITY);
+
+    // PDPT 项只有 P、PWT、PCD 可用，读写权限由页目录项决定
+    for (uint32_t i = 0; i < PG_L1_TABLES; i++)
+    {
+        pdpt[i] = NEW_L1_ENTRY(PG_PRESENT, PAE_TABLE(ptd, PG_PAE_DIRS + i));
+    }
+
+    // 对低1MiB以及hhk_init进行对等映射，与非 PAE 时相同，只是一个页表就覆盖了 2MiB
+    dirs[0] = NEW_L1_ENTRY(PG_PREM_RW, identity);
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        identity[i] = NEW_L2_ENTRY(PG_PREM_RW, (i << PG_SIZE_BITS));
+    }
+    for (uint32_t i = 0; i < HHK_PAGE_COUNT; i++)
+    {
+        identity[256 + i] = NEW_L2_ENTRY(PG_PREM_RW, 0x100000 + (i << PG_SIZE_BITS));
+    }
+
+    // 重映射内核至高半区。PAE 总是支持 2MiB 大页，所以不需要内核的页表
+    _map_kernel_large(dirs, _enable_global_pages());
+
+    // 递归映射：最后一个页目录的最后四项依次指向四个页目录（见 page.h）
+    for (uint32_t i = 0; i < PG_L1_TABLES; i++)
+    {
+        dirs[PG_L1_RECURSIVE + i] = NEW_L1_ENTRY(T_SELF_REF_PERM, PAE_TABLE(ptd, PG_PAE_DIRS + i));
+    }
+}
+#else
 void 
 _init_page(ptd_t* ptd) {
     // 将当前页表之后的第1024个页大小的位置映射到页表的第一个页表项中
-    SET_PDE(ptd, 0, NEW_L1_ENTRY(PG_PRESENT, ptd + PG_MAX_ENTRIES))
+    // 页目录项总是可写的，读写权限由页表项决定（CR0.WP 开启后内核也受其约束）
+    SET_PDE(ptd, 0, NEW_L1_ENTRY(PG_PREM_RW, ptd + PG_MAX_ENTRIES))
     
     // 对低1MiB空间进行对等映射（Identity mapping），也包括了我们的VGA，方便内核操作。
     for (uint32_t i = 0; i < 256; i++)  // 4KiB * 256 = 1MiB
@@ -147,46 +232,54 @@ _init_page(ptd_t* ptd) {
     //---- 到这里我们才正式开始映射内核！----
     // --- 将内核重映射至高半区 ---
     
-    // 这里是一些计算，主要是计算应当映射进的 页目录 与 页表 的条目索引（Entry Index）
-    uint32_t kernel_pde_index = L1_INDEX(sym_val(__kernel_start));
-    uint32_t kernel_pte_index = L2_INDEX(sym_val(__kernel_start));
-    uint32_t kernel_pg_counts = KERNEL_PAGE_COUNT;
+    uint32_t global = _enable_global_pages();
+
+    // 处理器支持 PSE 时用 4MiB 大页映射内核，否则使用页表 #2-4
+    if (_has_pse()) {
+        cpu_lcr4(cpu_rcr4() | CR4_PSE);
+        _map_kernel_large((x86_pte_t*)ptd, global);
+    } else {
+        // 这里是一些计算，主要是计算应当映射进的 页目录 与 页表 的条目索引（Entry Index）
+        uint32_t kernel_pde_index = L1_INDEX(sym_val(__kernel_start));
+        uint32_t kernel_pte_index = L2_INDEX(sym_val(__kernel_start));
+        uint32_t kernel_pg_counts = KERNEL_PAGE_COUNT;
     
-    // 将内核所需要的页表注册进页目录
-    //  当然，就现在而言，我们的内核只占用不到50个页（每个页表包含1024个页）
-    //  这里分配了3个页表（12MiB），未雨绸缪。
-    //PG_TABLE_STACK - PG_TABLE_KERNEL = 3
-    //所以 i = 0, 1, 2 刚好 3个 与前面定义符合(看注释)
-    for (uint32_t i = 0; i < PG_TABLE_STACK - PG_TABLE_KERNEL; i++)
-    {
-        // 分三个 页表
-        SET_PDE(
-            ptd, 
-            kernel_pde_index + i,   
-            NEW_L1_ENTRY(PG_PREM_RW, PT_ADDR(ptd, PG_TABLE_KERNEL + i))
-        )
-    }
+        // 将内核所需要的页表注册进页目录
+        //  当然，就现在而言，我们的内核只占用不到50个页（每个页表包含1024个页）
+        //  这里分配了3个页表（12MiB），未雨绸缪。
+        //PG_TABLE_STACK - PG_TABLE_KERNEL = 3
+        //所以 i = 0, 1, 2 刚好 3个 与前面定义符合(看注释)
+        for (uint32_t i = 0; i < PG_TABLE_STACK - PG_TABLE_KERNEL; i++)
+        {
+            // 分三个 页表
+            SET_PDE(
+                ptd, 
+                kernel_pde_index + i,   
+                NEW_L1_ENTRY(PG_PREM_RW, PT_ADDR(ptd, PG_TABLE_KERNEL + i))
+            )
+        }
     
-    // 首先，检查内核的大小是否可以fit进我们这几个表（12MiB）
-    if (kernel_pg_counts > (PG_TABLE_STACK - PG_TABLE_KERNEL) * PG_MAX_ENTRIES) {
-        // ERROR: require more pages
-        //  here should do something else other than head into blocking
-        while (1);
-    }
+        // 首先，检查内核的大小是否可以fit进我们这几个表（12MiB）
+        if (kernel_pg_counts > (PG_TABLE_STACK - PG_TABLE_KERNEL) * PG_MAX_ENTRIES) {
+            // ERROR: require more pages
+            //  here should do something else other than head into blocking
+            while (1);
+        }
     
-    // 计算内核.text段的物理地址
-    uintptr_t kernel_pm = V2P(&__kernel_start);
+        // 计算内核.text段的物理地址
+        uintptr_t kernel_pm = V2P(&__kernel_start);
     
-    // 重映射内核至高半区地址（>=0xC0000000）
-    for (uint32_t i = 0; i < kernel_pg_counts; i++)
-    {
-        // 正式开始映射内核 代码地址 ==> 高半核地址(也就是往高内存地址写入经处理后的原内存地址)
-        SET_PTE(
-            ptd, 
-            PG_TABLE_KERNEL, 
-            kernel_pte_index + i, 
-            NEW_L2_ENTRY(PG_PREM_RW, kernel_pm + (i << PG_SIZE_BITS))
-        )
+        // 重映射内核至高半区地址（>=0xC0000000）
+        for (uint32_t i = 0; i < kernel_pg_counts; i++)
+        {
+            // 正式开始映射内核 代码地址 ==> 高半核地址(也就是往高内存地址写入经处理后的原内存地址)
+            SET_PTE(
+                ptd, 
+                PG_TABLE_KERNEL, 
+                kernel_pte_index + i, 
+                NEW_L2_ENTRY(PG_PREM_RW | global, kernel_pm + (i << PG_SIZE_BITS))
+            )
+        }
     }
 
     // 最后一个entry用于循环映射
@@ -198,6 +291,7 @@ _init_page(ptd_t* ptd) {
         NEW_L1_ENTRY(T_SELF_REF_PERM, ptd)/*将ptd起始地址。。。。(懵了)*/
     );
 }
+#endif
 
 // 复制 mmap_addr 到 destination(destination+current) ??
 uint32_t __save_subset(uint8_t* destination, uint8_t* base, unsigned int size) {
@@ -235,11 +329,22 @@ _save_multiboot_info(multiboot_info_t* info, uint8_t* destination) {
         ((multiboot_info_t*) destination)->drives_addr = (uintptr_t)destination + current;
         current += __save_subset(destination + current, (uint8_t*)info->drives_addr, info->drives_length);
     }
+
+    //保存内核命令行，之后用于开关一些功能（如页着色）。mb_info 只有4096字节，过长的部分被截断
+    if (present(info->flags, MULTIBOOT_INFO_CMDLINE)) {
+        uint8_t* cmdline = (uint8_t*)info->cmdline;
+        ((multiboot_info_t*) destination)->cmdline = (uintptr_t)destination + current;
+        for (; *cmdline && current < MB_INFO_SIZE - 1; current++, cmdline++)
+        {
+            *(destination + current) = *cmdline;
+        }
+        *(destination + current) = '\0';
+    }
 }
 
 void 
 _hhk_init(ptd_t* ptd, uint32_t kpg_size) {
-    //kpg_size = KPG_SIZE = 24*1024
+    //kpg_size = KPG_SIZE = 24*1024（PAE 下为 48*1024）
 
     // ptd 为 页表目录 地址
 
@@ -1,5 +1,6 @@
 #include <hal/acpi/acpi.h>
 
+#include <awa/mm/ioremap.h>
 #include <awa/mm/kalloc.h>
 #include <awa/spike.h>
 #include <awa/syslog.h>
@@ -7,6 +8,7 @@
 #include <klibc/string.h>
 
 #include "parser/madt_parser.h"
+#include "parser/srat_parser.h"
 
 static acpi_context* toc = NULL;
 
@@ -18,6 +20,22 @@ acpi_rsdp_validate(acpi_rsdp_t* rsdp);
 acpi_rsdp_t*
 acpi_locate_rsdp(multiboot_info_t* mb_info);
 
+// ACPI 表位于系统预留的内存中，须经 ioremap 映射后访问。先映射表头得到长度，再映射整张表。
+// 解析的结果指向表内的（MADT、SLIT）映射一直保留，其余的表用完即解除映射，
+//  以免每个表项都占用一个 ioremap 槽位
+static void*
+acpi_map_table(uintptr_t pa)
+{
+    acpi_sdthdr_t* hdr = ioremap(pa, sizeof(acpi_sdthdr_t), PG_MEM_WB);
+    if (!hdr) {
+        return NULL;
+    }
+    size_t len = hdr->length;
+    iounmap(hdr);
+
+    return ioremap(pa, len, PG_MEM_WB);
+}
+
 int
 acpi_init(multiboot_info_t* mb_info)
 {
@@ -28,7 +46,8 @@ acpi_init(multiboot_info_t* mb_info)
 
     kprintf(KINFO "RSDP found at %p, RSDT: %p\n", rsdp, rsdp->rsdt);
 
-    acpi_rsdt_t* rsdt = rsdp->rsdt;
+    acpi_rsdt_t* rsdt = acpi_map_table((uintptr_t)rsdp->rsdt);
+    assert_msg(rsdt, "Fail to map ACPI_RSDT");
 
     toc = lxcalloc(1, sizeof(acpi_context));
     assert_msg(toc, "Fail to create ACPI context");
@@ -38,12 +57,24 @@ acpi_init(multiboot_info_t* mb_info)
 
     size_t entry_n = (rsdt->header.length - sizeof(acpi_sdthdr_t)) >> 2;
     for (size_t i = 0; i < entry_n; i++) {
-        acpi_sdthdr_t* sdthdr = ((acpi_apic_t**)&(rsdt->entry))[i];
+        acpi_sdthdr_t* sdthdr = acpi_map_table((uintptr_t)((acpi_sdthdr_t**)&(rsdt->entry))[i]);
+        if (!sdthdr) {
+            continue;
+        }
         switch (sdthdr->signature) {
             case ACPI_MADT_SIG:
                 madt_parse((acpi_madt_t*)sdthdr, toc);
                 break;
+            case ACPI_SRAT_SIG:
+                // 亲和性信息已复制到 toc 中
+                srat_parse((acpi_srat_t*)sdthdr, toc);
+                iounmap(sdthdr);
+                break;
+            case ACPI_SLIT_SIG:
+                slit_parse((acpi_slit_t*)sdthdr, toc);
+                break;
             default:
+                iounmap(sdthdr);
                 break;
         }
     }
@@ -59,6 +90,14 @@ acpi_init(multiboot_info_t* mb_info)
 
         kprintf(KINFO "IRQ #%u -> GSI #%u\n", intso->source, intso->gsi);
     }
+
+    for (size_t i = 0; i < toc->srat.mem_count; i++) {
+        acpi_srat_mem_range_t* mem = &toc->srat.mem[i];
+        kprintf(KINFO "NUMA: domain #%u, mem %p - %p\n",
+                mem->proximity,
+                mem->start,
+                mem->end);
+    }
 }
 
 acpi_context*
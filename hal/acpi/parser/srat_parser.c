@@ -0,0 +1,80 @@
+#include "srat_parser.h"
+
+void
+srat_parse(acpi_srat_t* srat, acpi_context* toc)
+{
+    uint8_t* aff_start = (uint8_t*)((uintptr_t)srat + sizeof(acpi_srat_t));
+    uintptr_t aff_end = (uintptr_t)srat + srat->header.length;
+
+    acpi_srat_toc_t* stoc = &toc->srat;
+    while (aff_start < (uint8_t*)aff_end) {
+        acpi_srat_hdr_t* entry = (acpi_srat_hdr_t*)aff_start;
+        if (!entry->length) {
+            break;
+        }
+
+        switch (entry->type) {
+            case ACPI_SRAT_LAPIC:
+            {
+                acpi_srat_lapic_t* lapic = (acpi_srat_lapic_t*)entry;
+                if (!(lapic->flags & ACPI_SRAT_ENABLED) ||
+                    stoc->cpu_count >= ACPI_SRAT_CPU_MAX) {
+                    break;
+                }
+                uint32_t proximity = lapic->proximity_lo |
+                                     (lapic->proximity_hi[0] << 8) |
+                                     (lapic->proximity_hi[1] << 16) |
+                                     (lapic->proximity_hi[2] << 24);
+                stoc->cpu[stoc->cpu_count++] = (acpi_srat_cpu_t){
+                    .apic_id = lapic->apic_id, .proximity = proximity
+                };
+                break;
+            }
+            case ACPI_SRAT_X2APIC:
+            {
+                acpi_srat_x2apic_t* x2apic = (acpi_srat_x2apic_t*)entry;
+                if (!(x2apic->flags & ACPI_SRAT_ENABLED) ||
+                    stoc->cpu_count >= ACPI_SRAT_CPU_MAX) {
+                    break;
+                }
+                stoc->cpu[stoc->cpu_count++] = (acpi_srat_cpu_t){
+                    .apic_id = x2apic->x2apic_id, .proximity = x2apic->proximity
+                };
+                break;
+            }
+            case ACPI_SRAT_MEM:
+            {
+                acpi_srat_mem_t* mem = (acpi_srat_mem_t*)entry;
+                // 我们只能访问低 4GiB 的物理内存
+                if (!(mem->flags & ACPI_SRAT_ENABLED) || mem->base_high ||
+                    stoc->mem_count >= ACPI_SRAT_MEM_MAX) {
+                    break;
+                }
+                uint64_t end = (uint64_t)mem->base_low +
+                               ((uint64_t)mem->len_high << 32) + mem->len_low;
+                stoc->mem[stoc->mem_count++] = (acpi_srat_mem_range_t){
+                    .proximity = mem->proximity,
+                    .start = mem->base_low,
+                    .end = end > 0xFFFFF000ULL ? 0xFFFFF000U : (uintptr_t)end
+                };
+                break;
+            }
+            default:
+                break;
+        }
+
+        aff_start += entry->length;
+    }
+}
+
+void
+slit_parse(acpi_slit_t* slit, acpi_context* toc)
+{
+    // 距离矩阵以字节存储，超过 255 个节点的情况我们不考虑
+    if (slit->locality_high || slit->locality_low > 0xff) {
+        return;
+    }
+
+    toc->slit.locality_count = slit->locality_low;
+    toc->slit.distance = (uint8_t*)((uintptr_t)slit + sizeof(acpi_slit_t));
+}
@@ -0,0 +1,22 @@
+#ifndef __AWA_PARSER_SRAT_PARSER_H
+#define __AWA_PARSER_SRAT_PARSER_H
+
+#include <hal/acpi/acpi.h>
+
+/**
+ * @brief Parse the SRAT and populated into main TOC
+ *
+ * @param srat SRAT
+ * @param toc The main TOC
+ */
+void srat_parse(acpi_srat_t* srat, acpi_context* toc);
+
+/**
+ * @brief Parse the SLIT and populated into main TOC
+ *
+ * @param slit SLIT
+ * @param toc The main TOC
+ */
+void slit_parse(acpi_slit_t* slit, acpi_context* toc);
+
+#endif
@@ -20,6 +20,8 @@
 
 LOG_MODULE("APIC")
 
+uintptr_t apic_base_vaddr;
+
 void
 apic_setup_lvts();
 
@@ -50,6 +50,14 @@ cpu_has_apic() {
     return (edx & 0x100);
 }
 
+int
+cpu_has_pat() {
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    return (edx & (1 << 16));
+}
+
 void
 cpu_rdmsr(uint32_t msr_idx, uint32_t* reg_high, uint32_t* reg_low)
 {
@@ -65,3 +73,33 @@ cpu_wrmsr(uint32_t msr_idx, uint32_t reg_high, uint32_t reg_low)
 {
     asm volatile("wrmsr" : : "d"(reg_high), "a"(reg_low), "c"(msr_idx));
 }
+
+uint32_t
+cpu_llc_way_size()
+{
+    // reference: Intel manual, CPUID leaf 04H (Deterministic Cache Parameters)
+    if (__get_cpuid_max(0, 0) < 4) {
+        return 0;
+    }
+
+    reg32 eax = 0, ebx = 0, edx = 0, ecx = 0;
+    uint32_t level = 0, way_size = 0;
+    for (uint32_t i = 0;; i++) {
+        __cpuid_count(4, i, eax, ebx, ecx, edx);
+        uint32_t type = eax & 0x1f;
+        if (!type) {
+            break;
+        }
+        // 只关心数据缓存与统一缓存，取级别最高的那个
+        if (type == 2 || ((eax >> 5) & 0x7) < level) {
+            continue;
+        }
+        level = (eax >> 5) & 0x7;
+
+        uint32_t line = (ebx & 0xfff) + 1;
+        uint32_t partitions = ((ebx >> 12) & 0x3ff) + 1;
+        uint32_t sets = ecx + 1;
+        way_size = line * partitions * sets;
+    }
+    return way_size;
+}
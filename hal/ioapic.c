@@ -3,6 +3,8 @@
 #include <hal/acpi/acpi.h>
 
 
+uintptr_t ioapic_base_vaddr;
+
 #define IOAPIC_REG_SEL     *((volatile uint32_t*)(IOAPIC_BASE_VADDR + IOAPIC_IOREGSEL))
 #define IOAPIC_REG_WIN     *((volatile uint32_t*)(IOAPIC_BASE_VADDR + IOAPIC_IOWIN))
 
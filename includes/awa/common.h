@@ -4,8 +4,19 @@
 #include <stddef.h>
 
 #define K_STACK_SIZE            (64 << 10)                              //内核栈大小为64KB
+#ifdef CONFIG_PAE
+#define K_STACK_START           ((0xFF7FFFFFU - K_STACK_SIZE) + 1)      //内核栈起始地址（PAE 的递归映射占据最高的 8MiB）
+#else
 #define K_STACK_START           ((0xFFBFFFFFU - K_STACK_SIZE) + 1)      //内核栈起始地址
+#endif
+#define PG_MOUNT_1              (K_STACK_START - 0x1000)                //临时挂载物理页的窗口，位于内核栈之下
 #define HIGHER_HLF_BASE         0xC0000000UL                            //高半段起始地址
+#define K_DIRECT_MAP_SIZE       (768UL << 20)                           //直接映射区大小，覆盖 ZONE_DMA 与 ZONE_NORMAL
+#define K_DIRECT_MAP_END        (HIGHER_HLF_BASE + K_DIRECT_MAP_SIZE)   //直接映射区 [HIGHER_HLF_BASE, 0xF0000000)，内核映像也在其中
+#define K_HEAP_START            K_DIRECT_MAP_END                        //内核堆起始地址，紧接直接映射区
+#define K_HEAP_END              0xF8000000UL                            //内核堆结束地址（128MiB）
+#define K_VAREA_START           K_HEAP_END                              //内核虚拟区域，由 vmm_reserve_range 分配
+#define K_VAREA_END             0xFF000000UL                            //之上为挂载窗口、内核栈与递归映射
 #define MEM_1MB                 0x100000UL                              //1MB(字节)
 
 #define VGA_BUFFER_VADDR        0xB0000000UL    // VGA缓冲区虚拟地址
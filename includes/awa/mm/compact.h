@@ -0,0 +1,43 @@
+#ifndef __AWA_COMPACT_H
+#define __AWA_COMPACT_H
+// Physical memory compaction
+// 内存整理
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief 内存整理的统计
+ */
+struct vmm_compact_stats
+{
+    size_t attempts;        // 尝试整理的次数
+    size_t succeeded;       // 成功得到一个完整空闲块的次数
+    size_t migrated;        // 累计迁移的页数
+    size_t failed;          // 迁移失败（目标页分配失败，或该页被多个页表项引用）的页数
+};
+
+/**
+ * @brief 整理物理内存，得到一个 2^order 个页的对齐空闲块。
+ * 块中已占用的页被复制到块外的新页上：通过递归映射遍历所有页表，找到引用它们的页表项，
+ * 改写后使用 invlpg 使其生效。整理期间关闭中断。
+ * 只迁移可迁移（PP_FL_MOVABLE）且恰好被一个页表项引用的页；物理地址已经交出去的页
+ * （再次被映射，或经由 vmm_lookup 查询过）不再可迁移，会使整理失败。
+ * 分配器不会自行整理，由空闲循环或需要大块的调用者在分配失败后调用，再重新分配。
+ *
+ * @param order 阶，1 ~ PM_MAX_ORDER
+ * @param zone 从该区域开始，依次向更低的区域查找
+ * @return int 是否得到了完整的空闲块（已归还给位图，可由 pmm_alloc_pages 分配）
+ */
+int
+vmm_compact(uint32_t order, int zone);
+
+/**
+ * @brief 获取内存整理的统计
+ *
+ * @param stats 输出
+ */
+void
+vmm_compact_stats(struct vmm_compact_stats* stats);
+
+#endif /* __AWA_COMPACT_H */
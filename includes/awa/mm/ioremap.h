@@ -0,0 +1,41 @@
+#ifndef __AWA_IOREMAP_H
+#define __AWA_IOREMAP_H
+// MMIO 映射
+
+#include <awa/mm/page.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief 将物理地址 [pa, pa + size) 映射到内核虚拟区域中。
+ * 已有映射完全包含该范围且内存类型相同时，共享该映射并增加其引用计数；
+ * 与已有映射重叠但内存类型不同时失败（同一物理地址不应有不同的内存类型）。
+ * 小于一个大页的范围立即映射；更大的范围（如显卡的 BAR）只保留地址，首次访问时才经由缺页
+ * 以大页（物理地址未对齐的部分以 4KiB 页）映射。
+ *
+ * @param pa 物理地址，不必页对齐
+ * @param size 字节数
+ * @param memtype 内存类型，PG_MEM_*（见 page.h）
+ * @return void* pa 对应的虚拟地址，失败时为 NULL
+ */
+void*
+ioremap(paddr_t pa, size_t size, pt_attr memtype);
+
+/**
+ * @brief 放弃 ioremap 所得映射的一个引用，最后一个引用放弃时解除映射（不释放物理页）并归还地址
+ *
+ * @param va ioremap 返回的地址（或该映射中的任意地址）
+ */
+void
+iounmap(void* va);
+
+/**
+ * @brief 处理 ioremap 区域中的缺页，由 vmm_handle_fault 调用
+ *
+ * @param va 引发缺页的地址
+ * @return int va 是否位于某个 ioremap 区域中并已映射
+ */
+int
+ioremap_fault(void* va);
+
+#endif
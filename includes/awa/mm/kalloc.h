@@ -36,4 +36,27 @@ lxcalloc(size_t n, size_t elem);
 void
 lxfree(void* ptr);
 
+/**
+ * @brief Allocate a virtually contiguous, un-initialized memory region backed by
+ * individually allocated (physically scattered) pages.
+ *
+ * @remarks
+ *  The region lives in the kernel virtual area, not in the heap, so freeing it
+ *  returns every page to the PMM. Prefer it over lxmalloc for large buffers.
+ *  An unmapped guard page follows the region.
+ *
+ * @param size in bytes, rounded up to page size
+ * @return void* page aligned, NULL on failure
+ */
+void*
+vmalloc(size_t size);
+
+/**
+ * @brief Free the memory region allocated by vmalloc
+ *
+ * @param ptr exactly the pointer returned by vmalloc, NULL is ignored
+ */
+void
+vfree(void* ptr);
+
 #endif
@@ -0,0 +1,73 @@
+#ifndef __AWA_MEMBLOCK_H
+#define __AWA_MEMBLOCK_H
+// Early boot memory allocator
+// 启动早期的内存分配器
+
+#include <arch/x86/boot/multiboot.h>
+#include <awa/mm/page.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEMBLOCK_REGIONS_MAX    32                  // 最多记录的可用区域数
+#define MEMBLOCK_LIMIT          (16UL << 20)        // 早期分配只使用低 16MiB，它们总在直接映射区中
+
+/**
+ * @brief 由 Multiboot 内存映射建立可用区域表，并预留 [0, reserved_end) 与 VGA 缓冲区。
+ * 应在 pmm_init 之前调用
+ *
+ * @param map Memory map
+ * @param map_size 表项数
+ * @param reserved_end 内核映像结束处的物理地址
+ */
+void
+memblock_init(multiboot_memory_map_t* map, size_t map_size, uintptr_t reserved_end);
+
+/**
+ * @brief 从可用区域中移除 [start, end)，之后既不会被分配，也不会移交给 PMM
+ *
+ * @param start 起始物理地址
+ * @param end 结束物理地址（不含）
+ */
+void
+memblock_reserve(paddr_t start, paddr_t end);
+
+/**
+ * @brief 在直接映射区建立之前分配一段物理连续的内存，不清零。
+ * 内存位于 MEMBLOCK_LIMIT 之下。移交给 PMM 之后不再可用
+ *
+ * @param size 字节数
+ * @param align 对齐，必须为 2 的幂
+ * @return paddr_t 物理地址，失败时为 0
+ */
+paddr_t
+memblock_alloc_phys(size_t size, size_t align);
+
+/**
+ * @brief 在堆可用之前分配一段物理连续、已清零的内存。
+ * 内存位于 MEMBLOCK_LIMIT 之下，经由直接映射区访问，因此须在 vmm_init_direct_map 之后调用。
+ * 移交给 PMM 之后不再可用
+ *
+ * @param size 字节数
+ * @param align 对齐，必须为 2 的幂
+ * @return void* 虚拟地址，失败时为 NULL
+ */
+void*
+memblock_alloc(size_t size, size_t align);
+
+/**
+ * @brief 将剩余的可用区域移交给 PMM（经由 pmm_defer_chunk_free），此后 memblock 停止工作
+ *
+ * @param regions 输出移交的区域数，可为 NULL
+ * @return size_t 移交的页数
+ */
+size_t
+memblock_handover(size_t* regions);
+
+/**
+ * @brief 可用内存的最高物理页号（不含），在 memblock_init 之后即可用于 pmm_init。
+ * PAE 下包括 4GiB 以上的内存（至多 PM_MAX_PAGES 个页）
+ */
+uintptr_t
+memblock_max_pfn();
+
+#endif /* __AWA_MEMBLOCK_H */
@@ -5,9 +5,32 @@
 
 #define PG_SIZE_BITS                12                      // 12位 即页大小为4KB
 #define PG_SIZE                     (1 << PG_SIZE_BITS)     // 4KB : (1 << 12)= 1 * 2^12
-#define PG_INDEX_BITS               10                      // 10位 页索引的比特位数
 
+#ifdef CONFIG_PAE
+/*
+ * PAE：CR3 -> 页目录指针表（PDPT，4 项）-> 页目录（512 项）-> 页表（512 项），表项为 64 位。
+ * 四个页目录合起来看作一张 2048 项的一级页表（L1），于是其余代码依然按两级页表处理：
+ *      L1_INDEX = va[31:21]，L2_INDEX = va[20:12]
+ * PDPT 的四项在启动时一次填好，之后不再改动（修改 PDPT 需要重新加载 CR3）
+ */
+#define PG_INDEX_BITS               9                       // 9位 页索引的比特位数
+#define PG_MAX_ENTRIES              512U                    // 每张表 512 项
+#define PG_L1_TABLES                4U                      // 四个页目录组成一级页表
+#define PG_ADDR_MASK                0x000FFFFFFFFFF000ULL   // 表项中的物理地址部分
+#else
+#define PG_INDEX_BITS               10                      // 10位 页索引的比特位数
 #define PG_MAX_ENTRIES              1024U                   // 1024个最大页表项
+#define PG_L1_TABLES                1U
+#define PG_ADDR_MASK                0xFFFFF000U             // 表项中的物理地址部分
+#endif
+
+#define PG_L1_ENTRIES               (PG_MAX_ENTRIES * PG_L1_TABLES)     // 一级页表的项数
+#define PG_L1_RECURSIVE             (PG_L1_ENTRIES - PG_L1_TABLES)      // 一级页表中第一个用于递归映射的项
+
+// 大页：由一个一级页表项（置位 PG_PDE_4MB）直接映射，非 PAE 下为 4MiB（需要 CR4.PSE），PAE 下为 2MiB
+#define PG_LARGE_SIZE_BITS          (PG_SIZE_BITS + PG_INDEX_BITS)
+#define PG_LARGE_SIZE               (1UL << PG_LARGE_SIZE_BITS)
+#define PG_LARGE_ORDER              PG_INDEX_BITS                       // 一个大页所含的页数的阶，供 pmm_alloc_pages 使用
 #define PG_LAST_TABLE               PG_MAX_ENTRIES - 1      // 最后一个页表项的索引
 #define PG_FIRST_TABLE              0                       // 第一个页表项的索引
 
@@ -20,8 +43,13 @@
 //最高20位保持不变 最低12位被清零   4KB对齐?
 #define PG_ALIGN(addr)      ((uintptr_t)(addr)   & 0xFFFFF000UL)        // 将地址转换为页对齐的地址
 
+#ifdef CONFIG_PAE
+#define L1_INDEX(vaddr)     (uint32_t)(((uintptr_t)(vaddr) & 0xFFE00000UL) >> 21)   // 获取一级页表索引（四个页目录连在一起）
+#define L2_INDEX(vaddr)     (uint32_t)(((uintptr_t)(vaddr) & 0x001FF000UL) >> 12)   // 获取页表索引
+#else
 #define L1_INDEX(vaddr)     (uint32_t)(((uintptr_t)(vaddr) & 0xFFC00000UL) >> 22)   // 获取虚拟页目录索引 PDE?
 #define L2_INDEX(vaddr)     (uint32_t)(((uintptr_t)(vaddr) & 0x003FF000UL) >> 12)   // 获取虚拟页表索引 PTE?
+#endif
 #define PG_OFFSET(vaddr)    (uint32_t)((uintptr_t)(vaddr)  & 0x00000FFFUL)        // 获取页内偏移
 
 #define GET_PT_ADDR(pde)    PG_ALIGN(pde)   // 获取页目录地址
@@ -37,16 +65,41 @@
 #define PG_ALLOW_USER           (0x1 << 2)  // 页表 [允许用户访问]
 #define PG_WRITE_THROUGHT       (1 << 3)    // 页表 [写回缓存]
 #define PG_DISABLE_CACHE        (1 << 4)    // 页表 [禁用缓存]
-#define PG_PDE_4MB              (1 << 7)    // 页表 [4MB]
+#define PG_PDE_4MB              (1 << 7)    // 页表 [4MB]（PS 位，PAE 下为 2MiB）
+#define PG_GLOBAL               (1 << 8)    // 全局页（需要 CR4.PGE），重载 CR3 时不被刷出 TLB，只用于内核空间
+#define PG_PAT                  (1 << 7)    // 4KiB 页表项的 PAT 位（一级页表项中同一位是 PS）
+#define PG_LARGE_PAT            (1 << 12)   // 大页的 PAT 位，位于表项的地址部分
+#define PG_COW                  (1 << 9)    // 写时复制（软件使用的 AVL 位），此时页表项是只读的
+#define PG_VAREA_ALT            (1 << 10)   // vmm_map_page 另取的内核虚拟区域地址（AVL 位），解除映射时归还
+
+#define IS_LARGE_PDE(pde)       ((pde) & PG_PDE_4MB)    // 一级页表项是否直接映射一个大页
+
+/*
+ * 内存类型：由页表项的 PAT、PCD、PWT 三位组成 PAT 的序号，vmm_init 按如下方式设置 PAT：
+ *      0 WB, 1 WT, 2 UC-, 3 UC, 4 WC（其余同 1-3）
+ * 0-3 与上电时的默认值相同，所以不支持 PAT 的处理器上 WB/WT/UC-/UC 照常可用，WC 则退化为 UC-。
+ * 大页的 PAT 位是 PG_LARGE_PAT，由 vmm 在写入表项时转换，pt_attr 中总是使用 PG_PAT
+ */
+#define PG_MEM_WB               0
+#define PG_MEM_WT               PG_WRITE_THROUGHT
+#define PG_MEM_UC_MINUS         PG_DISABLE_CACHE                        // 可被 MTRR 的 WC 覆盖
+#define PG_MEM_UC               (PG_WRITE_THROUGHT | PG_DISABLE_CACHE)  // 强不可缓存，用于 MMIO 寄存器
+#define PG_MEM_WC               PG_PAT                                  // 写合并，用于显存等帧缓冲
+#define PG_MEM_MASK             (PG_PAT | PG_DISABLE_CACHE | PG_WRITE_THROUGHT)
 
 #define NEW_L1_ENTRY(flags, pt_addr)     (PG_ALIGN(pt_addr) | ((flags) & 0xfff))    // 新建页目录项 pde
 #define NEW_L2_ENTRY(flags, pg_addr)     (PG_ALIGN(pg_addr) | ((flags) & 0xfff))    // 新建页表项 pte
 
-#define V_ADDR(pd, pt, offset)  ((pd) << 22 | (pt) << 12 | (offset)) // 获取虚拟地址
+// 以 paddr_t 新建页表项，PAE 下物理地址可以在 4GiB 以上（上面两个只接受指针或 32 位地址）
+#define NEW_L2_ENTRY_PA(flags, paddr)    ((x86_pte_t)((paddr) & PG_ADDR_MASK) | ((flags) & 0xfff))
+
+#define V_ADDR(pd, pt, offset)  ((pd) << (PG_INDEX_BITS + 12) | (pt) << 12 | (offset)) // 获取虚拟地址
 #define P_ADDR(ppn, offset)     ((ppn << 12) | (offset)) // 获取物理地址
 
 #define PG_ENTRY_FLAGS(entry)   (entry & 0xFFFU) // 获取页表属性
-#define PG_ENTRY_ADDR(entry)   (entry & ~0xFFFU) // 获取页表地址
+#define PG_ENTRY_ADDR(entry)   (entry & PG_ADDR_MASK) // 获取页表地址（paddr_t）
+#define PG_ENTRY_PPN(entry)    ((uintptr_t)(PG_ENTRY_ADDR(entry) >> PG_SIZE_BITS)) // 获取物理页号
+#define PG_LARGE_ADDR(entry)   (PG_ENTRY_ADDR(entry) & ~(x86_pte_t)PG_LARGE_PAT)     // 获取大页的物理地址（去掉 PAT 位）
 
 #define HAS_FLAGS(entry, flags)             ((PG_ENTRY_FLAGS(entry) & (flags)) == flags) // 判断页表是否包含 flags中所有的属性
 #define CONTAINS_FLAGS(entry, flags)        (PG_ENTRY_FLAGS(entry) & (flags)) // 判断页表是否包含 至少flags中的一个属性
@@ -56,8 +109,8 @@
 #define PG_PREM_UR             PG_PRESENT | PG_ALLOW_USER               // 页表  [允许用户访问]
 #define PG_PREM_URW            PG_PRESENT | PG_WRITE | PG_ALLOW_USER    // 页表  [允许用户读写]
 
-// 用于对PD进行循环映射，因为我们可能需要对PD进行频繁操作，我们在这里禁用TLB缓存
-#define T_SELF_REF_PERM        PG_PREM_RW | PG_DISABLE_CACHE
+// 用于对PD进行循环映射：内核可读写，按 WB 缓存；随地址空间变化，所以不带 PG_GLOBAL（见 __vmm_leaf_attr）
+#define T_SELF_REF_PERM        PG_PREM_RW
 
 
 /*
@@ -110,10 +163,22 @@ PTE 指向 物理页
         同理:
             0xFFFFF000 + i * 4      表示一个指向 l1t第i个页表项(可以看作l2t页表) 的指针
 */
+#ifdef CONFIG_PAE
+/*
+ * PAE 下没有一张能同时充当页目录与页表的表，改为：最后一个页目录（PD3）的最后四项
+ *  依次指向 PD0 ~ PD3。于是：
+ *      0xFF800000 + i * 4096   为一级页表第 i 项所指的页表（i 即 L1_INDEX）
+ *      0xFFFFC000              为 PD0 ~ PD3，它们在这里连成一张 2048 项的一级页表
+ * 递归映射占据最高的 8MiB，即一级页表的 [PG_L1_RECURSIVE, PG_L1_ENTRIES)
+ */
+#define L1_BASE_VADDR                0xFFFFC000U
+#define L2_BASE_VADDR                0xFF800000U
+#else
 #define L1_BASE_VADDR                0xFFFFF000U
 
 // 页表的虚拟基地址，可以用来访问到各个PTE
 #define L2_BASE_VADDR                 0xFFC00000U   //为下面L2_VADDR 提供 上面注释中所提到的L1头
+#endif
 
 // 用来获取特定的页表的虚拟地址
 #define L2_VADDR(pd_offset)           (L2_BASE_VADDR | (pd_offset << 12)) //因为 >> 12 所以要 << 12才能的到虚拟地址(舍弃掉offset位)
@@ -126,21 +191,34 @@ typedef unsigned int pt_attr;
  * @brief 虚拟映射属性
  * 
  */
+#ifdef CONFIG_PAE
+typedef uint64_t paddr_t;   // 物理地址，PAE 下可达 36 位以上
+typedef uint64_t x86_pte_t;
+#else
+typedef uintptr_t paddr_t;
+typedef uint32_t x86_pte_t;
+#endif
+
 typedef struct {
     // 物理页码（如果不存在映射，则为0）
     uint32_t pn;
     // 物理页地址（如果不存在映射，则为0）
-    uintptr_t pa;
+    paddr_t pa;
     // 映射的flags
     uint16_t flags;
 } v_mapping;
 
-typedef uint32_t x86_pte_t;
 typedef struct
 {
     x86_pte_t entry[PG_MAX_ENTRIES]; // "页表"数组 也就是 页表 页表中保存了页表项PTE PTE指向物理页
 } __attribute__((packed)) x86_page_table;
 
+// 经由 L1_BASE_VADDR 看到的一级页表（PAE 下为四个页目录连在一起）
+typedef struct
+{
+    x86_pte_t entry[PG_L1_ENTRIES];
+} __attribute__((packed)) x86_page_dir;
+
 
 
 #endif
@@ -6,7 +6,114 @@
 #include <stddef.h>
 
 #define PM_PAGE_SIZE            4096        // 每个物理页的大小
+#ifdef CONFIG_PAE
+#define PM_BMP_MAX_SIZE        (512 * 1024) // 位图的最大 大小，PAE 下最多管理 16GiB
+#else
 #define PM_BMP_MAX_SIZE        (128 * 1024) // 位图的最大 大小
+#endif
+#define PM_MAX_PAGES            (PM_BMP_MAX_SIZE * 8)   // 最多管理的物理页数
+#define PM_BMP_WORD_BITS        32          // 位图以 32 位的字进行存储和扫描
+#define PM_BMP_WORDS            (PM_BMP_MAX_SIZE / sizeof(uint32_t))
+#define PM_MAX_ORDER            10          // 伙伴系统的最大阶：2^10 个页，即 4MiB
+#define PM_COLOR_MAX            256         // 页着色最多使用的颜色数（LLC 每路 1MiB）
+
+// 物理页的所有者（类型）
+#define PP_FREE                 0           // 空闲，或位于页缓存中
+#define PP_RESERVED             1           // 内核映像、BIOS、MMIO等系统预留页，永不释放
+#define PP_KERNEL               2           // 内核的一般分配
+#define PP_PAGETABLE            3           // 页表或页目录
+
+// 物理页的标志
+#define PP_FL_PINNED            0x1         // 已固定，回收或迁移时必须跳过
+#define PP_FL_BLOCK_HEAD        0x2         // 由 pmm_alloc_pages 分配的块的首页，private 为其阶
+#define PP_FL_MOVABLE           0x4         // 只通过一个页表项访问，内存整理时可以迁移到别的物理页
+
+// 内存区域
+#define ZONE_DMA                0           // [0, 16MiB)，供 ISA DMA 等只能访问低地址的设备使用
+#define ZONE_NORMAL             1           // [16MiB, 768MiB)
+#define ZONE_HIGH               2           // [768MiB, 4GiB)
+#ifdef CONFIG_PAE
+#define ZONE_PAE                3           // [4GiB, 16GiB)，只能经由页表访问，见 pmm_alloc_frame
+#define PM_ZONE_COUNT           4
+#else
+#define PM_ZONE_COUNT           3
+#endif
+
+#define PM_ZONE_DMA_END         ((16UL << 20) >> 12)    // ZONE_DMA 的结束页号
+#define PM_ZONE_NORMAL_END      ((768UL << 20) >> 12)   // ZONE_NORMAL 的结束页号
+#define PM_ZONE_HIGH_END        (1UL << 20)             // ZONE_HIGH 的结束页号，即 4GiB
+
+/**
+ * @brief 内存区域。区域的页号范围为 [start_pg, end_pg)
+ */
+struct pm_zone
+{
+    const char* name;
+    uintptr_t start_pg;
+    uintptr_t end_pg;
+    uintptr_t lookup_ptr;   // 区域内 next-fit 的起点
+    size_t free_count;      // 区域内空闲（位图中未占用）的页数
+    size_t watermark;       // 其他区域的分配回落至此时，需保留的最少空闲页数（只有 ZONE_DMA 非 0）
+};
+
+#define PM_NODE_MAX             8           // 最多支持的 NUMA 节点数
+
+/**
+ * @brief NUMA 节点，即 SRAT 中的一个邻近域（proximity domain）
+ */
+struct pm_node
+{
+    uint32_t proximity;     // 邻近域编号
+    size_t free_count;      // 节点内空闲（位图中未占用）的页数
+    size_t alloc_count;     // 从本节点分配出去的页数
+    size_t remote_count;    // 其中分配给其他节点上的处理器的页数
+};
+
+/**
+ * @brief 预清零页池的统计
+ */
+struct pm_zero_stats
+{
+    size_t pool_hits;       // 从池中取得已清零的页，即省去一次清零的次数
+    size_t pool_misses;     // 池为空，调用者只能自行清零的次数
+    size_t idle_zeroed;     // 空闲时清零并放入池中的页数
+};
+
+#define PM_STATS_HIST           11          // 空闲段长度直方图的桶数
+
+/**
+ * @brief 物理内存的统计快照，由 pmm_stats 填写。以下页数之间满足：
+ * total = free + cached + used + reserved + offline
+ */
+struct pm_stats
+{
+    size_t total;           // 物理页总数
+    size_t free;            // 位图中空闲的页数
+    size_t cached;          // 位于页缓存与预清零页池中，随时可用的页数
+    size_t used;            // 已分配出去的页数
+    size_t reserved;        // 系统预留页数（内核映像、BIOS、MMIO，以及描述符建立前的分配）
+    size_t offline;         // 尚未上线的页数
+    size_t alloc_pages;     // 累计分配的页数，两次快照之差除以间隔即为分配速率
+    size_t free_pages;      // 累计释放的页数
+    size_t largest_run;     // 最长的连续空闲页数
+    size_t run_hist[PM_STATS_HIST]; // 长度在 [2^i, 2^(i+1)) 的空闲段个数，最后一桶为 >= 2^10
+    uint64_t scan_cycles;   // 在位图与伙伴树中查找空闲页累计花费的 TSC 周期
+    size_t scan_count;      // 查找的次数
+};
+
+/**
+ * @brief 物理页描述符，每个物理页对应一个。
+ * 16 字节，即每条 64 字节的缓存行可以容纳 4 个。
+ */
+struct pm_page
+{
+    uint16_t ref_count; // 引用计数，为 0 时才可真正释放
+    uint8_t type;       // 所有者，PP_*
+    uint8_t flags;      // PP_FL_*
+    uint32_t lru_prev;  // LRU 链表中前一个页的物理页号（0 即无）
+    uint32_t lru_next;  // LRU 链表中后一个页的物理页号（0 即无）
+    uint32_t private;   // 由所有者自行解释
+} __attribute__((aligned(16)));
 
 /**
  * @brief 标注物理页为可使用
@@ -41,6 +148,22 @@ void pmm_mark_chunk_free(uintptr_t start_ppn, size_t page_count);
  */
 void pmm_mark_chunk_occupied(uintptr_t start_ppn, size_t page_count);
 
+/**
+ * @brief 标注多个连续的物理页为可用，但允许延迟上线：
+ * 启动早期所需的低端内存立即可用，其余部分之后由 pmm_online_deferred 或分配失败时逐块上线。
+ *
+ * @param start_ppn 起始PPN
+ * @param page_count 数量
+ */
+void pmm_defer_chunk_free(uintptr_t start_ppn, size_t page_count);
+
+/**
+ * @brief 上线一块（4MiB）延迟的可用内存。应在内核初始化完成后的空闲时调用。
+ *
+ * @return int 是否还有尚未上线的内存
+ */
+int pmm_online_deferred();
+
 
 /**
  * @brief 分配一个可用的物理页
@@ -53,14 +176,15 @@ void* pmm_alloc_page();
 /**
  * @brief 初始化物理内存管理器
  * 
- * @param mem_upper_lim 最大可用内存地址
+ * @param max_pfn 最高可用物理页号（不含），超出 PM_MAX_PAGES 的部分被忽略
  */
-void pmm_init(uintptr_t mem_upper_lim);
+void pmm_init(uintptr_t max_pfn);
 
 
 
 /**
- * @brief 释放一个已分配的物理页，假若页地址不存在，则无操作。
+ * @brief 释放一个已分配的物理页（减少一次引用），假若页地址不存在或为系统预留，则无操作。
+ * 传入 pmm_alloc_pages 分配的块的首页时，按 pmm_free_pages 释放整个块。
  * 
  * @param page 页地址
  * @return 是否成功
@@ -68,4 +192,299 @@ void pmm_init(uintptr_t mem_upper_lim);
 int pmm_free_page(void* page);
 
 
+/**
+ * @brief 建立物理页描述符数组（需在虚拟区域分配器可用后调用）。此时所有已占用的页均视为系统预留。
+ * 数组只为已上线的内存分配，其余部分随内存上线逐块分配。
+ * 
+ * @return 是否成功
+ */
+int pmm_init_pages();
+
+
+/**
+ * @brief 获取物理页的描述符
+ * 
+ * @param page 页地址
+ * @return struct pm_page* 描述符，若页不存在或描述符数组尚未建立，则为 NULL
+ */
+struct pm_page* pmm_page(void* page);
+
+
+/**
+ * @brief 增加物理页的引用计数，用于共享一个已分配的物理页
+ * 
+ * @param page 页地址
+ * @return 是否成功
+ */
+int pmm_ref_page(void* page);
+
+/**
+ * @brief 增加物理页的引用计数，同 pmm_ref_page。对 pmm_alloc_pages 分配的块，传入块的第一个页
+ *
+ * @param ppn 物理页号
+ * @return 是否成功（页未分配、为预留页或描述符数组尚未建立时为 0）
+ */
+int pmm_ref_frame(uintptr_t ppn);
+
+
+/**
+ * @brief 分配 2^order 个物理上连续的页，起始地址按块的大小对齐
+ * 
+ * @param order 阶（0 ~ PM_MAX_ORDER），如 order=4 即 64KiB
+ * @return void* 块的起始物理地址，否则为 NULL
+ */
+void* pmm_alloc_pages(uint32_t order);
+
+/**
+ * @brief 同 pmm_alloc_pages，但只查找现成的空闲块：失败时不归还页缓存。
+ * 供失败后另有退路的调用者（如以 4KiB 页代替大页）使用，可以在关中断时调用。
+ *
+ * @param order 阶，不大于 PM_MAX_ORDER
+ * @return void* 块的起始物理地址，失败时为 NULL
+ */
+void* pmm_try_alloc_pages(uint32_t order);
+
+
+/**
+ * @brief 释放由 pmm_alloc_pages 分配的块
+ * 
+ * @param addr 块的起始物理地址
+ * @param order 分配时所使用的阶，与块记录的阶不同时不做任何操作
+ * @return 是否成功
+ */
+int pmm_free_pages(void* addr, uint32_t order);
+
+/**
+ * @brief 把 pmm_alloc_pages 分配的块拆分为 2^order 个独立的页，每个页继承块的引用计数，
+ * 之后可以逐页以 pmm_free_frame 释放或以 pmm_ref_frame 共享。
+ * 仍以整块引用它的一方（如共享它的大页）照旧使用 pmm_ref_pages 与 pmm_free_pages，
+ *  二者对拆分后的块逐页增减引用。
+ *
+ * @param addr 块的起始物理地址
+ * @param order 分配时所使用的阶
+ * @return 是否成功，块已拆分过时也为 1
+ */
+int pmm_split_pages(void* addr, uint32_t order);
+
+/**
+ * @brief 增加块的一个引用，块已被拆分时增加其中每个页的引用
+ *
+ * @param addr 块的起始物理地址
+ * @param order 分配时所使用的阶
+ * @return 是否成功
+ */
+int pmm_ref_pages(void* addr, uint32_t order);
+
+
+/**
+ * @brief 从指定的区域中分配一个物理页，不经过页缓存。
+ * 该区域耗尽时依次回落至更低的区域（HIGH -> NORMAL -> DMA），但不会使 DMA 低于水位。
+ * 普通的 pmm_alloc_page 即按 ZONE_HIGH 分配，因此 DMA 区域会尽量留给驱动。
+ *
+ * @param zone ZONE_DMA, ZONE_NORMAL 或 ZONE_HIGH
+ * @return void* 物理地址，失败时为 NULL
+ */
+void* pmm_alloc_page_zone(int zone);
+
+/**
+ * @brief 从指定的区域中分配 2^order 个物理地址连续的页，回落规则同 pmm_alloc_page_zone。
+ *
+ * @param order 阶，不大于 PM_MAX_ORDER
+ * @param zone 区域
+ * @return void* 块的起始物理地址，失败时为 NULL
+ */
+void* pmm_alloc_pages_zone(uint32_t order, int zone);
+
+/**
+ * @brief 开启页着色。颜色数向下取整为 2 的幂，并且不超过 PM_COLOR_MAX
+ *
+ * @param colors 颜色数，即 LLC 每一路的大小除以页大小。小于 2 时关闭页着色
+ */
+void pmm_color_init(uint32_t colors);
+
+/**
+ * @brief 页着色所使用的颜色数，未开启时为 0
+ */
+uint32_t pmm_colors();
+
+/**
+ * @brief 分配一个颜色为 color 的物理页（物理页号 % 颜色数 == color % 颜色数），不经过页缓存。
+ * 这种颜色的页已经用完，或未开启页着色时，等同于 pmm_alloc_page
+ *
+ * @param color 颜色
+ * @return void* 物理地址，失败时为 NULL
+ */
+void* pmm_alloc_page_color(uint32_t color);
+
+/**
+ * @brief 批量分配 n 个物理页（不要求连续），只加锁一次，并以一次扫描填满 frames。
+ * 优先取本处理器页缓存中的页，其余按 pmm_alloc_page 的区域顺序从位图中取出。
+ *
+ * @param n 需要的页数
+ * @param frames 用于存放物理地址的数组，至少可容纳 n 项
+ * @return size_t 实际分配的页数，可能小于 n（部分成功）
+ */
+size_t pmm_alloc_pages_bulk(size_t n, void* frames[]);
+
+/**
+ * @brief 批量释放物理页，只加锁一次。页直接归还给位图，不经过页缓存。
+ *
+ * @param n 页数
+ * @param frames 物理地址数组
+ * @return size_t 成功释放（或减少引用）的页数，不可释放的页被跳过
+ */
+size_t pmm_free_pages_bulk(size_t n, void* frames[]);
+
+/*
+ * 以物理页号（frame）表示的分配接口。
+ * 以上以 void* 表示物理地址的接口只会返回 4GiB 以下的页；PAE 下 4GiB 以上的页（ZONE_PAE）
+ *  无法用指针表示，只能经由这组接口分配，并且只能通过页表项访问。不开启 PAE 时二者等价。
+ */
+
+/**
+ * @brief 分配一个物理页。PAE 下优先从 ZONE_PAE 中分配，把 4GiB 以下的页留给需要指针的分配
+ *
+ * @return uintptr_t 物理页号，失败时为 0
+ */
+uintptr_t pmm_alloc_frame();
+
+/**
+ * @brief 批量分配 n 个物理页，规则同 pmm_alloc_frame，其余同 pmm_alloc_pages_bulk
+ *
+ * @param n 需要的页数
+ * @param frames 用于存放物理页号的数组，至少可容纳 n 项
+ * @return size_t 实际分配的页数
+ */
+size_t pmm_alloc_frames_bulk(size_t n, uintptr_t frames[]);
+
+/**
+ * @brief 释放一个物理页，同 pmm_free_page
+ *
+ * @param ppn 物理页号
+ * @return 是否成功
+ */
+int pmm_free_frame(uintptr_t ppn);
+
+/**
+ * @brief 批量释放物理页，同 pmm_free_pages_bulk
+ *
+ * @param n 页数
+ * @param frames 物理页号数组
+ * @return size_t 成功释放（或减少引用）的页数，块的首页与不可释放的页一样被跳过
+ */
+size_t pmm_free_frames_bulk(size_t n, uintptr_t frames[]);
+
+/**
+ * @brief 获取物理页的描述符，同 pmm_page
+ *
+ * @param ppn 物理页号
+ * @return struct pm_page* 描述符，或 NULL
+ */
+struct pm_page* pmm_frame(uintptr_t ppn);
+
+/**
+ * @brief 从预清零页池中取出一个内容全为零的物理页。
+ * 池为空时返回 NULL，此时调用者应改用 pmm_alloc_page 并自行清零。
+ *
+ * @return void* 物理地址，或 NULL
+ */
+void* pmm_alloc_zeroed_page();
+
+/**
+ * @brief 清零空闲页并补充至预清零页池，直到池满或内存不足。应在空闲时调用。
+ *
+ * @return size_t 本次补充的页数
+ */
+size_t pmm_refill_zeroed_pool();
+
+/**
+ * @brief 获取预清零页池的统计
+ *
+ * @param stats 输出
+ */
+void pmm_zero_stats(struct pm_zero_stats* stats);
+
+/**
+ * @brief 根据 ZONE_DMA 的页数设定其水位，其他区域没有水位。应在所有可用内存标注完毕后调用。
+ */
+void pmm_init_zones();
+
+/**
+ * @brief 获取区域的信息
+ *
+ * @param zone 区域
+ * @return struct pm_zone* 不存在时为 NULL
+ */
+struct pm_zone* pmm_zone(int zone);
+
+
+/**
+ * @brief 获取物理内存的统计快照。计数部分在锁内读取；空闲段的统计在锁外扫描位图，
+ * 借助摘要位图跳过已满的区域，因此开销很小，可以周期性地调用。
+ *
+ * @param stats 输出
+ */
+void pmm_stats(struct pm_stats* stats);
+
+/**
+ * @brief 为内存整理选出一个 2^order 个页的对齐块，并将其隔离：块中的空闲页被标注为已占用，
+ * 之后的分配不会再落入其中。被选中的块中已占用的页都是可迁移的（PP_FL_MOVABLE），且数量最少。
+ * 要求调用者关闭中断，直到 pmm_compact_release 为止。
+ *
+ * @param order 阶，1 ~ PM_MAX_ORDER
+ * @param zone 从该区域开始，依次向更低的区域查找
+ * @return void* 块的起始物理地址，没有值得整理的块时为 NULL
+ */
+void* pmm_compact_isolate(uint32_t order, int zone);
+
+/**
+ * @brief 结束对块的整理：块中描述符为 PP_FREE 的页（原本空闲的，以及已被迁走的）归还给位图
+ *
+ * @param block pmm_compact_isolate 返回的地址
+ * @param order 阶
+ * @return int 整个块是否都已空闲
+ */
+int pmm_compact_release(void* block, uint32_t order);
+
+/**
+ * @brief 物理内存是否碎片化：空闲页足够多，却找不到一个 2^PM_MAX_ORDER 个页的空闲块
+ */
+int pmm_fragmented();
+
+/**
+ * @brief 将一段物理内存划归某个 NUMA 节点（以 4MiB 为粒度）。
+ * 第一次调用时，该邻近域接管原本覆盖全部内存的节点 0。
+ *
+ * @param proximity 邻近域编号
+ * @param start_pg 起始页号
+ * @param end_pg 结束页号（不含）
+ * @return int 节点编号，节点过多时为 -1
+ */
+int pmm_node_add_range(uint32_t proximity, uintptr_t start_pg, uintptr_t end_pg);
+
+/**
+ * @brief 所有内存范围登记完毕后，为每个节点建立按距离由近及远的回落顺序，
+ * 并确定当前处理器所在的节点。此后的分配优先使用本节点的内存。
+ *
+ * @param distance SLIT 距离矩阵，没有时为 NULL（此时本节点距离为 10，其他为 20）
+ * @param locality_count 矩阵的阶
+ * @param cpu_proximity 当前处理器的邻近域编号
+ */
+void pmm_numa_init(const uint8_t* distance,
+                   uint32_t locality_count,
+                   uint32_t cpu_proximity);
+
+/**
+ * @brief 获取节点的信息
+ *
+ * @param node 节点编号
+ * @return struct pm_node* 不存在时为 NULL
+ */
+struct pm_node* pmm_node(int node);
+
+/**
+ * @brief 获取节点的数量，没有 NUMA 信息时为 1
+ */
+int pmm_node_count();
+
 #endif
@@ -1,10 +1,48 @@
 #ifndef __AWA_VMM_H
 #define __AWA_VMM_H
+#include <awa/common.h>
 #include <awa/mm/page.h>
 #include <stddef.h>
 #include <stdint.h>
 // Virtual memory manager
 
+// 内核虚拟区域中一段已保留的地址
+typedef struct
+{
+    void* start;
+    size_t size;    // 字节数，为 0 即不存在
+} v_area;
+
+// 直接映射区所覆盖的物理页数（不含），由 vmm_init_direct_map 设定
+extern uintptr_t vmm_direct_pfns;
+
+/**
+ * @brief 直接映射区中物理地址所对应的虚拟地址。直接映射区可缓存，访问时无需临时映射
+ *
+ * @param pa 物理地址
+ * @return void* 虚拟地址，pa 不在直接映射区中时为 NULL
+ */
+static inline void*
+phys_to_virt(paddr_t pa)
+{
+    if ((pa >> PG_SIZE_BITS) >= vmm_direct_pfns) {
+        return NULL;
+    }
+    return (void*)P2V((uintptr_t)pa);
+}
+
+/**
+ * @brief 直接映射区中虚拟地址所对应的物理地址
+ *
+ * @param va 虚拟地址，须位于 [HIGHER_HLF_BASE, K_DIRECT_MAP_END) 中
+ * @return paddr_t 物理地址
+ */
+static inline paddr_t
+virt_to_phys(void* va)
+{
+    return V2P(va);
+}
+
 /**
  * @brief 初始化虚拟内存管理器
  *
@@ -12,17 +50,81 @@
 void
 vmm_init();
 
+/**
+ * @brief 将 [0, min(max_pfn, K_DIRECT_MAP_SIZE)) 的物理内存线性映射至 P2V(pa)，即直接映射区。
+ * 处理器支持时使用大页，否则所需的页表从 memblock 中分配。
+ * 应在 memblock_init 之后、任何 memblock_alloc 之前调用
+ *
+ * @param max_pfn 可用内存的最高物理页号（不含）
+ */
+void
+vmm_init_direct_map(uintptr_t max_pfn);
+
 /**
  * @brief 创建一个页目录
  *
- * @return ptd_entry* 页目录的物理地址，随时可以加载进CR3
+ * @return ptd_entry* 页目录的物理地址，随时可以加载进CR3（PAE 下为页目录指针表的物理地址）
  */
 x86_page_table*
 vmm_init_pd();
 
 /**
- * @brief 尝试建立一个映射关系。映射指定的物理页地址至虚拟页地址，如果指定的虚拟页地址已被占用
- * 则尝试寻找新的可用地址（改地址总是大于指定的地址）。
+ * @brief 以写时复制的方式复制当前的地址空间。用户空间（HIGHER_HLF_BASE 之下）的页在双方之间只读共享，
+ * 直到任何一方写入时才复制（见 vmm_handle_fault）；内核空间的页表由双方共享。
+ * 开销与页表的数量成正比，而与驻留内存的大小无关
+ *
+ * @return void* 新页目录的物理地址，随时可以加载进CR3；内存不足时为 NULL
+ */
+void*
+vmm_clone_pd();
+
+/**
+ * @brief 销毁一个不在使用中的页目录：释放（或减少引用）其用户空间的页与页表，以及页目录本身
+ *
+ * @param pd_pa 由 vmm_init_pd 或 vmm_clone_pd 创建的页目录的物理地址
+ */
+void
+vmm_destroy_pd(void* pd_pa);
+
+/**
+ * @brief 初始化内核虚拟区域分配器，整个 [K_VAREA_START, K_VAREA_END) 为空闲。由 vmm_init 调用
+ */
+void
+vmm_varea_init();
+
+/**
+ * @brief 在内核虚拟区域 [K_VAREA_START, K_VAREA_END) 中保留一段地址（first fit），不建立映射。
+ * 该区域中的地址只应经由这里取得
+ *
+ * @param size 字节数，向上取整至页大小
+ * @param align 对齐，必须为 2 的幂，小于页大小时按页对齐
+ * @return void* 起始地址，空间不足时为 NULL
+ */
+void*
+vmm_reserve_range(size_t size, size_t align);
+
+/**
+ * @brief 归还由 vmm_reserve_range 保留的地址。其中的映射须已由调用者解除
+ *
+ * @param va vmm_reserve_range 返回的起始地址
+ * @return int 是否成功（va 不是某段保留地址的起始地址时为 0）
+ */
+int
+vmm_release_range(void* va);
+
+/**
+ * @brief 查找包含 va 的保留地址
+ *
+ * @param va 虚拟地址
+ * @return v_area 保留地址的范围，va 未被保留时 size 为 0
+ */
+v_area
+vmm_lookup_range(void* va);
+
+/**
+ * @brief 尝试建立一个映射关系。映射指定的物理页地址至虚拟页地址，如果指定的虚拟页地址已被占用，
+ * 则经由 vmm_reserve_range 在内核虚拟区域中另取一页，解除其映射时（vmm_unmap_page、
+ * vmm_unmount_page 或包含它的 vmm_unmap_range、vmm_unmount_range）一并归还。
  *
  * @param vpn 虚拟页地址
  * @param pa 物理页地址
@@ -57,7 +159,8 @@ vmm_alloc_page(void* va, pt_attr tattr);
 
 
 /**
- * @brief 尝试分配多个连续的虚拟页
+ * @brief 尝试分配多个连续的虚拟页。
+ * 其物理页可能被内存整理迁移，需要固定物理地址（如 DMA）时应为其设置 PP_FL_PINNED。
  * 
  * @param va 起始虚拟地址
  * @param sz 大小（必须为4K对齐）
@@ -67,6 +170,49 @@ vmm_alloc_page(void* va, pt_attr tattr);
 int
 vmm_alloc_pages(void* va, size_t sz, pt_attr tattr);
 
+/**
+ * @brief 尝试分配多个连续的虚拟页，并保证其内容全为零。
+ * 优先使用预清零页池中的页，不足部分在映射后就地清零。
+ *
+ * @param va 起始虚拟地址
+ * @param sz 大小（必须为4K对齐）
+ * @param tattr 属性
+ * @return int 是否成功
+ */
+int
+vmm_alloc_zeroed_pages(void* va, size_t sz, pt_attr tattr);
+
+/**
+ * @brief 临时将一个物理页挂载到指定的虚拟页上（覆盖原有映射），以便内核访问其内容。
+ * 不会分配页表，因此虚拟页所在的页表必须已经存在。
+ *
+ * @param va 挂载窗口的虚拟页地址，如 PG_MOUNT_1
+ * @param pa 物理页地址
+ * @return void* 虚拟页地址，如页表不存在，则为 NULL
+ */
+void*
+vmm_mount_page(void* va, void* pa);
+
+/**
+ * @brief 以一个大页（4MiB，PAE 下为 2MiB）映射 va 处的 PG_LARGE_SIZE 字节至物理地址 pa。
+ * va 处若已有页表，该页表必须不含任何映射，会被回收。
+ *
+ * @param va 虚拟地址，须按 PG_LARGE_SIZE 对齐
+ * @param pa 物理地址，须按 PG_LARGE_SIZE 对齐
+ * @param tattr PDE 的属性
+ * @return void* 虚拟地址，如不成功（包括处理器不支持大页），则为 NULL
+ */
+void*
+vmm_map_large_page(void* va, paddr_t pa, pt_attr tattr);
+
+/**
+ * @brief 卸载由 vmm_mount_page 挂载的物理页。与 vmm_unmap_page 不同，不会释放该物理页。
+ *
+ * @param va 挂载窗口的虚拟页地址
+ */
+void
+vmm_unmount_page(void* va);
+
 /**
  * @brief 设置一个映射，如果映射已存在，则忽略。
  * 
@@ -78,24 +224,90 @@ void
 vmm_set_mapping(void* va, void* pa, pt_attr attr);
 
 /**
- * @brief 删除一个映射
+ * @brief 删除一个映射。若 va 落在大页中，只有当 va 为大页的起始地址时才会解除整个大页。
  *
  * @param vpn
  */
 void
 vmm_unmap_page(void* va);
 
+/**
+ * @brief 将物理地址连续的 [pa, pa + sz) 映射至 [va, va + sz)。同 vmm_set_mapping，已存在的映射保持不变。
+ * 每个页表只查找一次，且新建映射无需刷新 TLB
+ *
+ * @param va 虚拟地址，页对齐
+ * @param pa 物理地址，页对齐
+ * @param sz 字节数，页对齐
+ * @param attr PTE 的属性
+ * @return int 是否成功（页表分配失败或触及递归映射区域时为 0，已建立的映射不会撤销）
+ */
+int
+vmm_map_range(void* va, paddr_t pa, size_t sz, pt_attr attr);
+
+/**
+ * @brief 删除 [va, va + sz) 中的所有映射，并同 vmm_unmap_page 一样释放其物理页。
+ * TLB 在最后统一刷新：页数较少时逐页 invlpg，否则重载 CR3
+ *
+ * @param va 虚拟地址，页对齐
+ * @param sz 字节数，页对齐
+ */
+void
+vmm_unmap_range(void* va, size_t sz);
+
+/**
+ * @brief 删除 [va, va + sz) 中的所有映射，但与 vmm_unmount_page 一样不释放物理页。
+ * 用于映射了不归我们所有的物理地址（如 MMIO）的区域
+ *
+ * @param va 虚拟地址，页对齐
+ * @param sz 字节数，页对齐
+ */
+void
+vmm_unmount_range(void* va, size_t sz);
+
+/**
+ * @brief 登记一段按需分配的区域：只保留虚拟地址，其中的页在首次访问时（缺页）才分配物理页并清零
+ *
+ * @param va 起始虚拟地址，页对齐
+ * @param sz 字节数
+ * @param tattr PTE 的属性
+ * @return int 是否成功（区域表已满时为 0）
+ */
+int
+vmm_lazy_add(void* va, size_t sz, pt_attr tattr);
+
+/**
+ * @brief 处理缺页。va 落在按需分配的区域中且尚未映射时，为其分配一个全零的物理页；
+ * 落在 ioremap 的区域中时，映射其所在的 MMIO（见 ioremap_fault）；
+ * 写入写时复制的页时，为其复制一个私有的页
+ *
+ * @param va 引发缺页的地址（CR2）
+ * @param err_code 缺页错误码
+ * @return int 是否已处理，为 0 即真正的错误
+ */
+int
+vmm_handle_fault(void* va, uint32_t err_code);
+
+/**
+ * @brief 预先为 [va, va + sz) 分配页表，之后在其中映射 4KiB 页（vmm_map_range 等）不再需要分配内存。
+ * 供映射时无法向 PMM 申请页的调用者（如持有 PM 锁的 PMM 自身）使用
+ *
+ * @return int 是否成功（范围中有大页、触及递归映射区域或物理内存不足时为 0）
+ */
+int
+vmm_alloc_tables(void* va, size_t sz);
+
 /**
  * @brief 将虚拟地址翻译为其对应的物理映射
  *
  * @param va 虚拟地址
- * @return void* 物理地址，如映射不存在，则为NULL
+ * @return void* 物理地址，如映射不存在，则为NULL。PAE 下 4GiB 以上的物理地址无法用指针表示，
+ * 请使用 vmm_lookup
  */
 void*
 vmm_v2p(void* va);
 
 /**
- * @brief 查找一个映射
+ * @brief 查找一个映射。调用者得到了物理地址，所查到的页从此不再被内存整理迁移
  *
  * @param va 虚拟地址
  * @return v_mapping 映射相关属性
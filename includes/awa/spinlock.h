@@ -0,0 +1,27 @@
+#ifndef __AWA_SPINLOCK_H
+#define __AWA_SPINLOCK_H
+
+#include <stdint.h>
+
+// 最简单的自旋锁，用于保护多个处理器共享的数据。
+// 注意：它本身并不关闭中断，若中断处理程序中也会获取同一把锁，
+//  则需要配合 cpu_disable_interrupt_save 使用。
+typedef volatile uint32_t spinlock_t;
+
+#define SPINLOCK_INIT 0
+
+static inline void
+spinlock_acquire(spinlock_t* lock)
+{
+    while (__sync_lock_test_and_set(lock, 1)) {
+        asm volatile("pause");
+    }
+}
+
+static inline void
+spinlock_release(spinlock_t* lock)
+{
+    __sync_lock_release(lock);
+}
+
+#endif
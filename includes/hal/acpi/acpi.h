@@ -7,11 +7,14 @@
 
 #include "sdt.h"
 #include "madt.h"
+#include "srat.h"
 
 #define ACPI_RSDP_SIG_L       0x20445352      // 'RSD '
 #define ACPI_RSDP_SIG_H      0x20525450       // 'PTR '
 
 #define ACPI_MADT_SIG        0x43495041       // 'APIC'
+#define ACPI_SRAT_SIG        0x54415253       // 'SRAT'
+#define ACPI_SLIT_SIG        0x54494c53       // 'SLIT'
 
 typedef struct {
     uint32_t signature_l;
@@ -36,6 +39,9 @@ typedef struct
     // Make it as null terminated
     char oem_id[7];
     acpi_madt_toc_t madt;
+    // NUMA 拓扑，没有 SRAT 时 mem_count 与 cpu_count 均为 0
+    acpi_srat_toc_t srat;
+    acpi_slit_toc_t slit;
 } acpi_context;
 
 int
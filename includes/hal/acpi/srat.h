@@ -0,0 +1,121 @@
+#ifndef __AWA_ACPI_SRAT_H
+#define __AWA_ACPI_SRAT_H
+
+#include "sdt.h"
+
+#define ACPI_SRAT_LAPIC 0x0  // Processor Local APIC/SAPIC Affinity
+#define ACPI_SRAT_MEM 0x1    // Memory Affinity
+#define ACPI_SRAT_X2APIC 0x2 // Processor Local x2APIC Affinity
+
+#define ACPI_SRAT_ENABLED 0x1
+
+// 我们记录的内存范围与处理器的最大数量
+#define ACPI_SRAT_MEM_MAX 16
+#define ACPI_SRAT_CPU_MAX 16
+
+/**
+ * @brief ACPI System Resource Affinity Table (SRAT)
+ *
+ * Tell us which proximity domain (i.e., NUMA node) each processor and each
+ * range of memory belongs to.
+ *
+ */
+typedef struct
+{
+    acpi_sdthdr_t header;
+    uint32_t reserved1;
+    uint32_t reserved2[2];
+    // Here is a bunch of packed affinity structures reside here back-to-back.
+} __attribute__((packed)) acpi_srat_t;
+
+/**
+ * @brief Affinity structure header, same layout as ICS header in MADT
+ *
+ */
+typedef struct
+{
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed)) acpi_srat_hdr_t;
+
+typedef struct
+{
+    acpi_srat_hdr_t header;
+    uint8_t proximity_lo;
+    uint8_t apic_id;
+    uint32_t flags;
+    uint8_t sapic_eid;
+    uint8_t proximity_hi[3];
+    uint32_t clock_domain;
+} __attribute__((packed)) acpi_srat_lapic_t;
+
+typedef struct
+{
+    acpi_srat_hdr_t header;
+    uint32_t proximity;
+    uint16_t reserved1;
+    uint32_t base_low;
+    uint32_t base_high;
+    uint32_t len_low;
+    uint32_t len_high;
+    uint32_t reserved2;
+    uint32_t flags;
+    uint32_t reserved3[2];
+} __attribute__((packed)) acpi_srat_mem_t;
+
+typedef struct
+{
+    acpi_srat_hdr_t header;
+    uint16_t reserved1;
+    uint32_t proximity;
+    uint32_t x2apic_id;
+    uint32_t flags;
+    uint32_t clock_domain;
+    uint32_t reserved2;
+} __attribute__((packed)) acpi_srat_x2apic_t;
+
+/**
+ * @brief ACPI System Locality Distance Information Table (SLIT)
+ *
+ * A locality_count * locality_count matrix of relative distance between
+ * proximity domains. The distance to itself is always 10.
+ *
+ */
+typedef struct
+{
+    acpi_sdthdr_t header;
+    uint32_t locality_low;
+    uint32_t locality_high;
+    // Here is the distance matrix reside here.
+} __attribute__((packed)) acpi_slit_t;
+
+typedef struct
+{
+    uint32_t proximity;
+    uintptr_t start;
+    // 不含，超出 4GiB 的部分已被截去
+    uintptr_t end;
+} acpi_srat_mem_range_t;
+
+typedef struct
+{
+    uint32_t apic_id;
+    uint32_t proximity;
+} acpi_srat_cpu_t;
+
+typedef struct
+{
+    uint32_t mem_count;
+    acpi_srat_mem_range_t mem[ACPI_SRAT_MEM_MAX];
+    uint32_t cpu_count;
+    acpi_srat_cpu_t cpu[ACPI_SRAT_CPU_MAX];
+} acpi_srat_toc_t;
+
+typedef struct
+{
+    uint32_t locality_count;
+    // locality_count * locality_count 的距离矩阵，没有 SLIT 时为 NULL
+    uint8_t* distance;
+} acpi_slit_toc_t;
+
+#endif
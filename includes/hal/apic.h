@@ -3,7 +3,10 @@
 
 #include <stdint.h>
 
-#define APIC_BASE_VADDR 0x1000
+// Local APIC 寄存器的虚拟地址，由 _kernel_post_init 经 ioremap 映射
+extern uintptr_t apic_base_vaddr;
+
+#define APIC_BASE_VADDR apic_base_vaddr
 #define __APIC_BASE_PADDR 0xFEE00000
 
 #define IA32_APIC_BASE_MSR 0x1B
@@ -3,6 +3,9 @@
 
 #include <stdint.h>
 
+// 所支持的最大处理器数量
+#define CPU_MAX 8
+
 typedef unsigned int reg32;
 typedef unsigned short reg16;
 
@@ -34,14 +37,33 @@ cpu_get_brand(char* brand_out);
 int
 cpu_has_apic();
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wreturn-type"
+/**
+ * @brief 处理器是否支持 PAT（CPUID.01H:EDX.PAT[bit 16]）
+ */
+int
+cpu_has_pat();
+
+/**
+ * @brief 通过 CPUID leaf 4 获取最后一级缓存（LLC）每一路的大小，即 组数 * 行大小。
+ * 它除以页大小就是页着色可用的颜色数
+ *
+ * @return uint32_t 字节数，处理器不支持 leaf 4 时为 0
+ */
+uint32_t
+cpu_llc_way_size();
+
+#define CR0_WP      (1 << 16)   // 内核态写入只读页同样引发缺页（写时复制需要）
+
 static inline reg32
 cpu_rcr0()
 {
-    asm("mov %cr0, %eax");
+    reg32 v;
+    asm volatile("mov %%cr0, %0" : "=r"(v));
+    return v;
 }
 
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wreturn-type"
 static inline reg32
 cpu_rcr2()
 {
@@ -55,10 +77,28 @@ cpu_rcr3()
 }
 #pragma GCC diagnostic pop
 
+#define CR4_PSE     (1 << 4)    // 允许 4MiB 大页
+#define CR4_PAE     (1 << 5)
+#define CR4_PGE     (1 << 7)    // 允许全局页
+
+static inline reg32
+cpu_rcr4()
+{
+    reg32 v;
+    asm volatile("mov %%cr4, %0" : "=r"(v));
+    return v;
+}
+
+static inline void
+cpu_lcr4(reg32 v)
+{
+    asm volatile("mov %0, %%cr4" ::"r"(v) : "memory");
+}
+
 static inline void
 cpu_lcr0(reg32 v)
 {
-    asm("mov %0, %%cr0" ::"r"(v));
+    asm volatile("mov %0, %%cr0" ::"r"(v) : "memory");
 }
 
 static inline void
@@ -91,16 +131,97 @@ cpu_disable_interrupt()
     asm volatile("cli");
 }
 
+/**
+ * @brief 停机直到下一个中断到来，用于空闲循环
+ */
+static inline void
+cpu_idle()
+{
+    asm volatile("hlt");
+}
+
+/**
+ * @brief 关闭中断，并返回关闭前的 EFLAGS，配合 cpu_restore_interrupt 使用
+ *
+ * @return reg32 EFLAGS
+ */
+static inline reg32
+cpu_disable_interrupt_save()
+{
+    reg32 eflags;
+    asm volatile("pushfl\n"
+                 "popl %0\n"
+                 "cli"
+                 : "=r"(eflags)
+                 :
+                 : "memory");
+    return eflags;
+}
+
+/**
+ * @brief 若 cpu_disable_interrupt_save 之前中断是开启的（IF=1），则重新开启中断
+ *
+ * @param eflags cpu_disable_interrupt_save 的返回值
+ */
+static inline void
+cpu_restore_interrupt(reg32 eflags)
+{
+    if (eflags & 0x200) {
+        asm volatile("sti" ::: "memory");
+    }
+}
+
+/**
+ * @brief 当前处理器的编号
+ *
+ * FUTURE: 目前只有引导处理器（BSP）在运行，AP 启动后改为读取 Local APIC ID
+ */
+static inline uint32_t
+cpu_id()
+{
+    return 0;
+}
+
+/**
+ * @brief 读取时间戳计数器（TSC）
+ */
+static inline uint64_t
+cpu_rdtsc()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
 static inline void
 cpu_invtlb()
 {
     reg32 interm;
-    asm("movl %%cr3, %0\n"
-        "movl %0, %%cr3"
-        : "=r"(interm)
-        : "r"(interm));
+    asm volatile("movl %%cr3, %0\n"
+                 "movl %0, %%cr3"
+                 : "=r"(interm)
+                 :
+                 : "memory");
 }
 
+/**
+ * @brief 刷新整个 TLB，包括全局页。
+ * 重载 CR3 不会刷出全局页的 TLB 项，须清除再恢复 CR4.PGE。修改内核映射后应使用它代替 cpu_invtlb
+ */
+static inline void
+cpu_invtlb_all()
+{
+    reg32 cr4 = cpu_rcr4();
+    if (cr4 & CR4_PGE) {
+        cpu_lcr4(cr4 & ~CR4_PGE);
+        cpu_lcr4(cr4);
+    } else {
+        cpu_invtlb();
+    }
+}
+
+#define IA32_PAT_MSR    0x277
+
 void
 cpu_rdmsr(uint32_t msr_idx, uint32_t* reg_high, uint32_t* reg_low);
 
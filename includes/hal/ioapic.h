@@ -20,7 +20,10 @@
 #define IOAPIC_INTPOL_L             (1 << 13)
 #define IOAPIC_DESTMOD_LOGIC        (1 << 11)
 
-#define IOAPIC_BASE_VADDR   0x2000
+// IOAPIC 寄存器的虚拟地址，由 _kernel_post_init 经 ioremap 映射
+extern uintptr_t ioapic_base_vaddr;
+
+#define IOAPIC_BASE_VADDR   ioapic_base_vaddr
 
 void
 ioapic_init();
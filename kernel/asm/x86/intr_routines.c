@@ -2,6 +2,7 @@
 #include <awa/tty/tty.h>
 #include <awa/spike.h>
 #include <awa/syslog.h>
+#include <awa/mm/vmm.h>
 
 #include <klibc/stdio.h>
 
@@ -37,6 +38,12 @@ void
 intr_routine_page_fault (const isr_param* param) 
 {
     void* pg_fault_ptr = cpu_rcr2();
+
+    // 按需分配的区域（如内核堆）中的缺页不是错误
+    if (vmm_handle_fault(pg_fault_ptr, param->err_code)) {
+        return;
+    }
+
     if (!pg_fault_ptr) {
         __print_panic_msg("Null pointer reference", param);
     } else {
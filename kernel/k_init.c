@@ -4,11 +4,14 @@
 #include <awa/mm/page.h>
 #include <awa/mm/pmm.h>
 #include <awa/mm/vmm.h>
+#include <awa/mm/ioremap.h>
 #include <awa/mm/kalloc.h>
+#include <awa/mm/memblock.h>
 #include <awa/spike.h>
 #include <awa/syslog.h>
 #include <awa/timer.h>
 
+#include <hal/cpu.h>
 #include <hal/rtc.h>
 #include <hal/apic.h>
 #include <hal/ioapic.h>
@@ -32,19 +35,25 @@ extern uint8_t __init_hhk_end;
 // Set remotely by kernel/asm/x86/prologue.S
 multiboot_info_t* _k_init_mb_info;
 
+// 内核命令行中含有 "bench" 时，_kernel_main 运行各项性能测试
+int _k_init_bench;
+
 LOG_MODULE("INIT");//设置一个内核专用的 kprintf函数 输出内容自带 "INIT" 标签开头
 
 void
-setup_memory(multiboot_memory_map_t* map, size_t map_size);
+setup_memory();
 
 void
 setup_kernel_runtime();
 
 void
-lock_reserved_memory();
+setup_numa();
+
+void
+setup_page_coloring();
 
 void
-unlock_reserved_memory();
+setup_bench();
 
 /*
  * 初始化7个模块(内容):
@@ -61,10 +70,16 @@ _kernel_pre_init() {
     _init_idt();    //初始化 IDT 并将 IDT数据和大小限制 分别存储进 _idt数组 和 _idt_limit变量
     intr_routine_init(); //没看到这部分，今后在写!!!!!!!!!!!!!!!!!!!!!
 
-    // (_k_init_mb_info->mem_upper << 10)将 KiB 转化为 字节
-    // 1KiB = 2^10字节 1MiB = 2^20字节
-    // 所以 mem_upper << 10 ----> mem_upper * 2^10
-    pmm_init(MEM_1MB + (_k_init_mb_info->mem_upper << 10));// 标记所有物理页为 [已占用]
+    // PMM 的元数据按内存大小从 memblock 中分配，所以 memblock 要先于 PMM 就绪
+    memblock_init((multiboot_memory_map_t*)_k_init_mb_info->mmap_addr,
+                  _k_init_mb_info->mmap_length / sizeof(multiboot_memory_map_t),
+                  V2P(&__kernel_end));
+
+    // 此后的早期分配都经由直接映射区访问
+    vmm_init_direct_map(memblock_max_pfn());
+
+    // 按 Memory map 中最高的可用内存确定物理页数（mem_upper 只有 32 位，表示不了 4GiB 以上的内存）
+    pmm_init(memblock_max_pfn());// 标记所有物理页为 [已占用]
     vmm_init();//这个函数内暂时没有任何内容
     rtc_init();//没看到这部分，今后在写!!!!!!!!!!!!!!!!!!!!!
 
@@ -85,13 +100,15 @@ _kernel_init() {
            _k_init_mb_info->mem_lower,  // 系统启动时可以立即访问的内存，该内存连续且位于较低的地址范围内，通常为1MB或者640KB
            _k_init_mb_info->mem_upper); // 除了mem_lower之外的其他可用内存，这部分内存位于较高地址范围内，且为不连续的块，这部分内存随着系统的发展可能包含更多的可用的RAM
 
-    //计算 位图 大小
-    unsigned int map_size = _k_init_mb_info->mmap_length / sizeof(multiboot_memory_map_t);
-    
-    //按照 Memory map 标识可用的物理页
-    setup_memory((multiboot_memory_map_t*)_k_init_mb_info->mmap_addr, map_size);
+    //按照 Memory map（已由 memblock 记录）标识可用的物理页
+    setup_memory();
+
+    // 内核栈与堆也应按颜色分配，所以要在它们之前开启
+    setup_page_coloring();
 
     setup_kernel_runtime();
+
+    setup_bench();
 }
 
 void 
@@ -100,95 +117,40 @@ _kernel_post_init() {
     kprintf(KINFO "[MM] Releaseing %d pages from 0x0.\n", hhk_init_pg_count);
 
     // Fuck it, I will no longer bother this little 1MiB
-    // I just release 4 pages for my APIC & IOAPIC remappings
+    // 页 0 ~ 2 不再对等映射，空指针的访问会引发缺页
     for (size_t i = 0; i < 3; i++) {
         vmm_unmap_page((void*)(i << PG_SIZE_BITS));
     }
-    
-    // 锁定所有系统预留页（内存映射IO，ACPI之类的），并且进行1:1映射
-    lock_reserved_memory();
 
+    // 系统预留的区域（MMIO，ACPI 表之类的）不再逐页对等映射，由使用者经 ioremap 映射用到的部分
     acpi_init(_k_init_mb_info);
     uintptr_t ioapic_addr = acpi_get_context()->madt.ioapic->ioapic_addr;
 
     pmm_mark_page_occupied(FLOOR(__APIC_BASE_PADDR, PG_SIZE_BITS));
     pmm_mark_page_occupied(FLOOR(ioapic_addr, PG_SIZE_BITS));
 
-    vmm_set_mapping(APIC_BASE_VADDR, __APIC_BASE_PADDR, PG_PREM_RW);
-    vmm_set_mapping(IOAPIC_BASE_VADDR, ioapic_addr, PG_PREM_RW);
+    // 寄存器的读写有副作用，必须是强不可缓存（UC）的，不能被 MTRR 改为 WC
+    apic_base_vaddr = (uintptr_t)ioremap(__APIC_BASE_PADDR, PG_SIZE, PG_MEM_UC);
+    ioapic_base_vaddr = (uintptr_t)ioremap(ioapic_addr, PG_SIZE, PG_MEM_UC);
+    assert_msg(apic_base_vaddr && ioapic_base_vaddr, "Fail to map APIC registers");
 
     apic_init();
     ioapic_init();
+    setup_numa();
     timer_init(SYS_TIMER_FREQUENCY_HZ);
 
-    for (size_t i = 256; i < hhk_init_pg_count; i++) {
-        vmm_unmap_page((void*)(i << PG_SIZE_BITS));
-    }
-}
-
-void
-lock_reserved_memory() {
-    multiboot_memory_map_t* mmaps = _k_init_mb_info->mmap_addr;
-    size_t map_size = _k_init_mb_info->mmap_length / sizeof(multiboot_memory_map_t);
-    for (unsigned int i = 0; i < map_size; i++) {
-        multiboot_memory_map_t mmap = mmaps[i];
-        if (mmap.type == MULTIBOOT_MEMORY_AVAILABLE) {
-            continue;
-        }
-        uint8_t* pa = PG_ALIGN(mmap.addr_low);
-        size_t pg_num = CEIL(mmap.len_low, PG_SIZE_BITS);
-        for (size_t j = 0; j < pg_num; j++)
-        {
-            vmm_set_mapping((pa + (j << PG_SIZE_BITS)), (pa + (j << PG_SIZE_BITS)), PG_PREM_R);
-        }
-    }
-}
-
-void
-unlock_reserved_memory() {
-    multiboot_memory_map_t* mmaps = _k_init_mb_info->mmap_addr;
-    size_t map_size = _k_init_mb_info->mmap_length / sizeof(multiboot_memory_map_t);
-    for (unsigned int i = 0; i < map_size; i++) {
-        multiboot_memory_map_t mmap = mmaps[i];
-        if (mmap.type == MULTIBOOT_MEMORY_AVAILABLE) {
-            continue;
-        }
-        uint8_t* pa = PG_ALIGN(mmap.addr_low);
-        size_t pg_num = CEIL(mmap.len_low, PG_SIZE_BITS);
-        for (size_t j = 0; j < pg_num; j++)
-        {
-            vmm_unmap_page((pa + (j << PG_SIZE_BITS)));
-        }
-    }
+    vmm_unmap_range((void*)(256 << PG_SIZE_BITS), (hhk_init_pg_count - 256) << PG_SIZE_BITS);
 }
 
 // 按照 Memory map 标识可用的物理页
 void
-setup_memory(multiboot_memory_map_t* map, size_t map_size) {
-
-    // First pass, to mark the physical pages
-    for (unsigned int i = 0; i < map_size; i++) {
-        multiboot_memory_map_t mmap = map[i];
-        kprintf("[MM] Base: 0x%x, len: %u KiB, type: %u\n",
-               map[i].addr_low,         //内存区域的起始地址
-               map[i].len_low >> 10,    //字节 转化为 KiB
-               map[i].type);            //内存区域类型 也就是分页属性:
-                                        //例如 MULTIBOOT_MEMORY_AVAILABLE
-
-        // 标记 内存 为 可用
-        if (mmap.type == MULTIBOOT_MEMORY_AVAILABLE) {
-            // 整数向上取整除法
-            uintptr_t pg = map[i].addr_low + 0x0fffU;
-
-            // pg >> PG_SIZE_BITS 计算起始页数
-            // map[i].len_low >> PG_SIZE_BITS 计算所占页数
-            // 连续标记多个页为可用
-            pmm_mark_chunk_free(pg >> PG_SIZE_BITS, map[i].len_low >> PG_SIZE_BITS);
-            kprintf(KINFO "[MM] Freed %u pages start from 0x%x\n",
-                   map[i].len_low >> PG_SIZE_BITS,  //计算页数，因为1页=4KiB=(1<<12)字节
-                   pg & ~0x0fffU);  //进行掩码操作保证地址是对齐到页面大小 (4KiB) 的
-        }
-    }
+setup_memory() {
+
+    // 早期分配已经结束，memblock 中剩余的可用内存全部交给 PMM
+    // 高端的可用内存会延迟上线，这里只统计，不再逐个区域输出
+    size_t avail_regions = 0;
+    size_t avail_pgs = memblock_handover(&avail_regions);
+    kprintf(KINFO "[MM] %u pages available in %u regions.\n", avail_pgs, avail_regions);
 
     // 将内核占据的页，包括前1MB，hhk_init 设为已占用
     size_t pg_count = V2P(&__kernel_end) >> PG_SIZE_BITS; //虚拟内存 ==> 物理内存 并计算占用页数
@@ -201,8 +163,21 @@ setup_memory(multiboot_memory_map_t* map, size_t map_size) {
     // 首先，标记VGA部分为已占用
     // VGA_BUFFER_PADDR >> PG_SIZE_BITS 计算页数
     pmm_mark_chunk_occupied(VGA_BUFFER_PADDR >> PG_SIZE_BITS, vga_buf_pgs); //连续标记多个 "VGA缓冲区" 页 [已占用]
+
+    // 可用内存已经全部标注完毕，据此设定各区域的水位
+    pmm_init_zones();
+    for (int i = 0; i < PM_ZONE_COUNT; i++) {
+        struct pm_zone* zone = pmm_zone(i);
+        // 以 MiB 输出，PAE 下区域的边界可以超过 4GiB
+        kprintf(KINFO "[MM] Zone %s: %u MiB - %u MiB, %u pages free\n",
+               zone->name,
+               zone->start_pg >> (20 - PG_SIZE_BITS),
+               zone->end_pg >> (20 - PG_SIZE_BITS),
+               zone->free_count);
+    }
     
     // 重映射VGA文本缓冲区（以后会变成显存，i.e., framebuffer）
+    // 以写合并（WC）方式映射，连续的写入在写缓冲中合并后成批写出，而不是逐次等待总线
     for (size_t i = 0; i < vga_buf_pgs; i++)
     {
         // i << PG_SIZE_BITS 实际上应该和 VGA_BUFFER_PADDR 一致
@@ -212,7 +187,7 @@ setup_memory(multiboot_memory_map_t* map, size_t map_size) {
         vmm_map_page(                                           //将 虚拟地址 与 物理地址 建立映射关系
             (void*)(VGA_BUFFER_VADDR + (i << PG_SIZE_BITS)),    //虚拟地址  为什么+i << PG_SIZE_BITS?
             (void*)(VGA_BUFFER_PADDR + (i << PG_SIZE_BITS)),    //物理地址
-            PG_PREM_RW                                          //页属性 [可读写]
+            PG_PREM_RW | PG_MEM_WC                              //页属性 [可读写] [写合并]
         );
     }
     
@@ -226,9 +201,96 @@ setup_memory(multiboot_memory_map_t* map, size_t map_size) {
 void
 setup_kernel_runtime() {
     // 为内核创建一个专属栈空间。
-    for (size_t i = 0; i < (K_STACK_SIZE >> PG_SIZE_BITS); i++) {
-        vmm_alloc_page((void*)(K_STACK_START + (i << PG_SIZE_BITS)), PG_PREM_RW);
-    }
+    assert_msg(vmm_alloc_pages((void*)K_STACK_START, K_STACK_SIZE, PG_PREM_RW),
+               "Fail to allocate kernel stack");
     kprintf(KINFO "[MM] Allocated %d pages for stack start at %p\n", K_STACK_SIZE>>PG_SIZE_BITS, K_STACK_START);
     assert_msg(kalloc_init(), "Fail to initialize heap");
+
+    // 堆可用后才能建立物理页描述符数组
+    assert_msg(pmm_init_pages(), "Fail to initialize page descriptors");
+}
+
+void
+setup_numa() {
+    acpi_context* acpi = acpi_get_context();
+    if (!acpi->srat.mem_count) {
+        return;
+    }
+
+    // 按 SRAT 把物理内存划分给各个节点
+    for (size_t i = 0; i < acpi->srat.mem_count; i++) {
+        acpi_srat_mem_range_t* mem = &acpi->srat.mem[i];
+        pmm_node_add_range(mem->proximity,
+                           mem->start >> PG_SIZE_BITS,
+                           mem->end >> PG_SIZE_BITS);
+    }
+
+    // 找出当前处理器（BSP）所在的邻近域
+    uint32_t apic_id = apic_read_reg(APIC_IDR) >> 24;
+    uint32_t cpu_proximity = 0;
+    for (size_t i = 0; i < acpi->srat.cpu_count; i++) {
+        if (acpi->srat.cpu[i].apic_id == apic_id) {
+            cpu_proximity = acpi->srat.cpu[i].proximity;
+        }
+    }
+
+    pmm_numa_init(acpi->slit.distance, acpi->slit.locality_count, cpu_proximity);
+
+    for (int i = 0; i < pmm_node_count(); i++) {
+        struct pm_node* node = pmm_node(i);
+        kprintf(KINFO "[MM] Node %d: domain #%u, %u pages free\n",
+               i,
+               node->proximity,
+               node->free_count);
+    }
+}
+
+// 内核命令行（以空格分隔）中是否含有 opt 这一项
+static int
+__cmdline_has(const char* opt)
+{
+    if (!(_k_init_mb_info->flags & MULTIBOOT_INFO_CMDLINE)) {
+        return 0;
+    }
+
+    const char* p = (const char*)_k_init_mb_info->cmdline;
+    while (*p) {
+        const char* o = opt;
+        while (*o && *p == *o) {
+            p++;
+            o++;
+        }
+        if (!*o && (*p == ' ' || !*p)) {
+            return 1;
+        }
+        while (*p && *p != ' ') {
+            p++;
+        }
+        while (*p == ' ') {
+            p++;
+        }
+    }
+    return 0;
+}
+
+void
+setup_page_coloring() {
+    // 页着色默认关闭，通过内核命令行中的 "pgcolor" 开启
+    if (!__cmdline_has("pgcolor")) {
+        return;
+    }
+
+    uint32_t way_size = cpu_llc_way_size();
+    pmm_color_init(way_size >> PG_SIZE_BITS);
+    if (!pmm_colors()) {
+        kprintf(KWARN "[MM] Page coloring unavailable (LLC way size: %u bytes).\n", way_size);
+        return;
+    }
+    kprintf(KINFO "[MM] Page coloring enabled, %u colors.\n", pmm_colors());
+}
+
+void
+setup_bench() {
+    // 性能测试默认不运行，通过内核命令行中的 "bench" 开启
+    _k_init_bench = __cmdline_has("bench");
 }
@@ -1,19 +1,91 @@
 #include <hal/cpu.h>
 #include <awa/syslog.h>
+#include <awa/mm/compact.h>
 #include <awa/mm/kalloc.h>
+#include <awa/mm/pmm.h>
 #include <awa/mm/vmm.h>
 #include <awa/spike.h>
 #include <awa/time.h>
 #include <awa/timer.h>
+#include <klibc/string.h>
 #include <stdint.h>
 
 extern uint8_t __kernel_start;
+extern int _k_init_bench;
 
 LOG_MODULE(" OS ")
 
 void 
 test_timer(void* payload);
 
+void
+report_memory(void* payload);
+
+void
+request_compact(void* payload);
+
+void
+print_memory_report();
+
+void
+bench_clone_pd();
+
+void
+bench_global_tlb();
+
+void
+bench_console();
+
+void
+bench_large_tlb();
+
+void
+bench_page_coloring();
+
+void
+bench_compaction();
+
+void
+bench_map_range();
+
+// 物理内存统计的报告周期（秒）
+#define MM_REPORT_PERIOD 60
+
+// 检查是否需要后台整理物理内存的周期（秒）
+#define MM_COMPACT_PERIOD 5
+
+// 写时复制测试所用的地址空间：用户空间中的 64MiB
+#define BENCH_CLONE_VADDR 0x40000000UL
+#define BENCH_CLONE_SIZE  (64UL << 20)
+
+// TLB 重新填充测试：每轮访问的页数与轮数
+#define BENCH_TLB_PAGES   64
+#define BENCH_TLB_ROUNDS  16
+
+// TLB 缺失测试：以 4KiB 页与大页分别映射的区域大小（远超 TLB 的覆盖范围）与遍历次数
+#define BENCH_LARGE_SIZE   (32UL << 20)
+#define BENCH_LARGE_ROUNDS 8
+
+// 显存写入测试：整屏写入的次数
+#define BENCH_CONSOLE_ROUNDS 64
+
+// 页着色测试：缓冲区的大小（与常见的 LLC 大小相当）、遍历次数与缓存行大小
+#define BENCH_COLOR_SIZE   (2UL << 20)
+#define BENCH_COLOR_ROUNDS 16
+#define BENCH_COLOR_LINE   64
+
+// 碎片化测试：最多占用的地址空间，尝试分配的块的阶（64KiB）与次数
+#define BENCH_FRAG_SIZE     (256UL << 20)
+#define BENCH_FRAG_ORDER    4
+#define BENCH_FRAG_ATTEMPTS 64
+
+// 批量映射测试：映射的区域大小，以及被映射的物理地址（只建立映射，不访问）
+#define BENCH_MAP_SIZE  (16UL << 20)
+#define BENCH_MAP_PADDR 0x100000UL
+
+static volatile int compact_pending;
+static volatile int report_pending;
+
 void
 _kernel_main()
 {
@@ -51,9 +123,264 @@ _kernel_main()
     lxfree(arr);
     lxfree(big_);
 
+    // test vmalloc & vfree: 大块内存不经过堆，释放后全部归还 PMM
+    uint8_t* huge = vmalloc(1 << 20);
+    assert_msg(huge, "vmalloc failed");
+    huge[0] = 1;
+    huge[(1 << 20) - 1] = 2;
+    kprintf(KINFO "vmalloc: %p, %u, %u\n", huge, huge[0], huge[(1 << 20) - 1]);
+    vfree(huge);
+
+    // 性能测试只在内核命令行中含有 "bench" 时运行
+    if (_k_init_bench) {
+        bench_clone_pd();
+        bench_global_tlb();
+        bench_console();
+        bench_large_tlb();
+        bench_page_coloring();
+        bench_compaction();
+        bench_map_range();
+    }
+
     timer_run_second(1, test_timer, NULL, TIMER_MODE_PERIODIC);
+    timer_run_second(MM_REPORT_PERIOD, report_memory, NULL, TIMER_MODE_PERIODIC);
+    timer_run_second(MM_COMPACT_PERIOD, request_compact, NULL, TIMER_MODE_PERIODIC);
+
+    // 空闲循环：逐块上线剩余的物理内存，补充预清零页池，按需报告内存统计、整理物理内存，
+    //  然后等待下一个中断
+    int pm_deferred = 1;
+    while (1) {
+        if (pm_deferred) {
+            pm_deferred = pmm_online_deferred();
+        }
+        pmm_refill_zeroed_pool();
+        if (report_pending) {
+            report_pending = 0;
+            print_memory_report();
+        }
+        if (compact_pending) {
+            compact_pending = 0;
+            if (pmm_fragmented()) {
+                vmm_compact(PM_MAX_ORDER, ZONE_HIGH);
+            }
+        }
+        cpu_idle();
+    }
+}
+
+// 没有 libgcc，不能做 64 位除法，周期数超过 32 位时以 2^shift 为单位输出
+static uint32_t
+__cycles32(uint64_t cycles, uint32_t* shift)
+{
+    *shift = 0;
+    while (cycles >> 32) {
+        cycles >>= 1;
+        (*shift)++;
+    }
+    return (uint32_t)cycles;
+}
+
+// 测量以写时复制的方式复制一个驻留了 64MiB 的地址空间，以及之后第一次写入一个页的开销。
+// 这段地址空间通常以大页映射，第一次写入包括把所在的大页拆分为页表
+void
+bench_clone_pd() {
+    uint8_t* base = (uint8_t*)BENCH_CLONE_VADDR;
+    if (!vmm_alloc_pages(base, BENCH_CLONE_SIZE, PG_PREM_RW)) {
+        kprintf(KWARN "[MM] clone bench skipped: cannot allocate %u MiB\n", BENCH_CLONE_SIZE >> 20);
+        return;
+    }
+    for (size_t off = 0; off < BENCH_CLONE_SIZE; off += PG_SIZE) {
+        base[off] = (uint8_t)(off >> PG_SIZE_BITS);
+    }
+
+    uint64_t begin = cpu_rdtsc();
+    void* pd = vmm_clone_pd();
+    uint64_t clone_cycles = cpu_rdtsc() - begin;
+
+    if (!pd) {
+        kprintf(KWARN "[MM] clone bench: vmm_clone_pd failed\n");
+        vmm_unmap_range(base, BENCH_CLONE_SIZE);
+        return;
+    }
+
+    // 页已被共享，第一次写入时复制
+    begin = cpu_rdtsc();
+    base[0] = 0xAA;
+    uint64_t fault_cycles = cpu_rdtsc() - begin;
+
+    vmm_destroy_pd(pd);
+    vmm_unmap_range(base, BENCH_CLONE_SIZE);
+
+    uint32_t clone_shift, fault_shift;
+    uint32_t c = __cycles32(clone_cycles, &clone_shift);
+    uint32_t f = __cycles32(fault_cycles, &fault_shift);
+    kprintf(KINFO "[MM] clone %u MiB: %u << %u cycles, first write: %u << %u cycles\n",
+           BENCH_CLONE_SIZE >> 20, c, clone_shift, f, fault_shift);
+}
+
+// 重载 CR3 之后依次读取 base 处的 BENCH_TLB_PAGES 个页，返回 BENCH_TLB_ROUNDS 轮的总周期数
+static uint64_t
+__bench_tlb_refill(volatile uint8_t* base)
+{
+    uint64_t total = 0;
+    for (int r = 0; r < BENCH_TLB_ROUNDS; r++) {
+        for (size_t i = 0; i < BENCH_TLB_PAGES; i++) {
+            (void)base[i << PG_SIZE_BITS];
+        }
+        cpu_invtlb();
+
+        uint64_t begin = cpu_rdtsc();
+        for (size_t i = 0; i < BENCH_TLB_PAGES; i++) {
+            (void)base[i << PG_SIZE_BITS];
+        }
+        total += cpu_rdtsc() - begin;
+    }
+    return total;
+}
+
+// 比较重载 CR3 后重新访问全局的内核页与非全局的用户页的开销
+void
+bench_global_tlb() {
+    size_t sz = BENCH_TLB_PAGES << PG_SIZE_BITS;
+    uint8_t* kbase = vmm_reserve_range(sz, PG_SIZE);
+    uint8_t* ubase = (uint8_t*)BENCH_CLONE_VADDR;
+    if (!kbase || !vmm_alloc_zeroed_pages(kbase, sz, PG_PREM_RW)) {
+        kprintf(KWARN "[MM] tlb bench skipped: cannot allocate kernel pages\n");
+        if (kbase) {
+            vmm_release_range(kbase);
+        }
+        return;
+    }
+    if (!vmm_alloc_zeroed_pages(ubase, sz, PG_PREM_RW)) {
+        kprintf(KWARN "[MM] tlb bench skipped: cannot allocate user pages\n");
+        vmm_unmap_range(kbase, sz);
+        vmm_release_range(kbase);
+        return;
+    }
+
+    uint32_t gshift, ushift;
+    uint32_t g = __cycles32(__bench_tlb_refill(kbase), &gshift);
+    uint32_t u = __cycles32(__bench_tlb_refill(ubase), &ushift);
+
+    vmm_unmap_range(ubase, sz);
+    vmm_unmap_range(kbase, sz);
+    vmm_release_range(kbase);
+
+    kprintf(KINFO "[MM] tlb refill %u pages x %u: global %u << %u, non-global %u << %u cycles%s\n",
+           BENCH_TLB_PAGES, BENCH_TLB_ROUNDS, g, gshift, u, ushift,
+           (cpu_rcr4() & CR4_PGE) ? "" : " (PGE unsupported)");
+}
+
+// 每个 4KiB 页读取一个字节，遍历 base 处的 BENCH_LARGE_SIZE 字节 BENCH_LARGE_ROUNDS 次，
+//  返回除第一次（预热）外的总周期数
+static uint64_t
+__bench_page_walk(volatile uint8_t* base)
+{
+    for (size_t off = 0; off < BENCH_LARGE_SIZE; off += PG_SIZE) {
+        (void)base[off];
+    }
+
+    uint64_t begin = cpu_rdtsc();
+    for (int r = 0; r < BENCH_LARGE_ROUNDS; r++) {
+        for (size_t off = 0; off < BENCH_LARGE_SIZE; off += PG_SIZE) {
+            (void)base[off];
+        }
+    }
+    return cpu_rdtsc() - begin;
+}
+
+// 比较遍历以 4KiB 页与以大页映射的同样大小的区域的开销，差别主要来自 TLB 缺失与页表遍历
+void
+bench_large_tlb() {
+    uint8_t* lbase = (uint8_t*)BENCH_CLONE_VADDR;
+    uint8_t* sbase = lbase + BENCH_LARGE_SIZE;
+    if (!vmm_alloc_zeroed_pages(lbase, BENCH_LARGE_SIZE, PG_PREM_RW)) {
+        kprintf(KWARN "[MM] large page bench skipped: cannot allocate %u MiB\n",
+               BENCH_LARGE_SIZE >> 20);
+        return;
+    }
+
+    // 每次分配不足一个大页，vmm_alloc_pages 就不会提升为大页
+    for (size_t off = 0; off < BENCH_LARGE_SIZE; off += PG_LARGE_SIZE / 2) {
+        if (!vmm_alloc_zeroed_pages(sbase + off, PG_LARGE_SIZE / 2, PG_PREM_RW)) {
+            kprintf(KWARN "[MM] large page bench skipped: cannot allocate %u MiB\n",
+                   BENCH_LARGE_SIZE >> 20);
+            vmm_unmap_range(sbase, off);
+            vmm_unmap_range(lbase, BENCH_LARGE_SIZE);
+            return;
+        }
+    }
 
-    spin();
+    // 没有现成的连续块（或处理器不支持大页）时，部分甚至全部区域仍以 4KiB 页映射
+    size_t large = 0;
+    for (size_t off = 0; off < BENCH_LARGE_SIZE; off += PG_LARGE_SIZE) {
+        if (vmm_lookup(lbase + off).flags & PG_PDE_4MB) {
+            large++;
+        }
+    }
+
+    uint32_t sshift, lshift;
+    uint32_t sc = __cycles32(__bench_page_walk(sbase), &sshift);
+    uint32_t lc = __cycles32(__bench_page_walk(lbase), &lshift);
+
+    vmm_unmap_range(sbase, BENCH_LARGE_SIZE);
+    vmm_unmap_range(lbase, BENCH_LARGE_SIZE);
+
+    kprintf(KINFO "[MM] walk %u MiB x %u: 4KiB pages %u << %u, large pages (%u/%u) %u << %u cycles\n",
+           BENCH_LARGE_SIZE >> 20, BENCH_LARGE_ROUNDS, sc, sshift,
+           large, BENCH_LARGE_SIZE / PG_LARGE_SIZE, lc, lshift);
+}
+
+// 把 screen 整屏写入 fb BENCH_CONSOLE_ROUNDS 次，返回周期数
+static uint64_t
+__bench_fb_write(volatile uint16_t* fb, uint16_t* screen)
+{
+    size_t cells = VGA_BUFFER_SIZE / sizeof(uint16_t);
+    uint64_t begin = cpu_rdtsc();
+    for (int r = 0; r < BENCH_CONSOLE_ROUNDS; r++) {
+        for (size_t i = 0; i < cells; i++) {
+            fb[i] = screen[i];
+        }
+    }
+    return cpu_rdtsc() - begin;
+}
+
+// 比较经由 WC 映射（setup_memory 中的 VGA_BUFFER_VADDR）与 UC 映射写入显存的开销。
+// 同一物理页不能同时以两种内存类型映射，所以先解除 WC 映射，在原地以 UC 映射测量，再恢复 WC。
+// 写入的是屏幕上原有的内容，画面不变
+void
+bench_console() {
+    static uint16_t screen[VGA_BUFFER_SIZE / sizeof(uint16_t)];
+    void* fb = (void*)VGA_BUFFER_VADDR;
+    memcpy(screen, fb, VGA_BUFFER_SIZE);
+
+    uint32_t wshift, ushift;
+    uint32_t w = __cycles32(__bench_fb_write(fb, screen), &wshift);
+
+    // 换成 UC 映射期间不能有任何输出，中断处理程序也不例外。
+    // invlpg 是串行化指令，WC 缓冲中的写入在解除映射时就已写出
+    reg32 eflags = cpu_disable_interrupt_save();
+    vmm_unmount_page(fb);
+    uint64_t uc_cycles = 0;
+    void* uc = vmm_map_page(fb, (void*)VGA_BUFFER_PADDR, PG_PREM_RW | PG_MEM_UC);
+    int mapped = uc == fb;
+    if (mapped) {
+        uc_cycles = __bench_fb_write(fb, screen);
+    }
+    if (uc) {
+        vmm_unmount_page(uc);
+    }
+    vmm_map_page(fb, (void*)VGA_BUFFER_PADDR, PG_PREM_RW | PG_MEM_WC);
+    cpu_restore_interrupt(eflags);
+
+    if (!mapped) {
+        kprintf(KWARN "[MM] console bench skipped: cannot map VGA buffer as UC\n");
+        return;
+    }
+
+    uint32_t u = __cycles32(uc_cycles, &ushift);
+    kprintf(KINFO "[MM] console %u screens: WC %u << %u, UC %u << %u cycles\n",
+           BENCH_CONSOLE_ROUNDS, w, wshift, u, ushift);
 }
 
 static datetime_t datetime;
@@ -70,3 +397,211 @@ void test_timer(void* payload) {
            datetime.minute,
            datetime.second);
 }
+
+// 整理会长时间关闭中断，不能在定时器中断中进行，只能交给空闲循环
+void
+request_compact(void* payload) {
+    (void)payload;
+    compact_pending = 1;
+}
+
+// 统计要遍历整个位图并持有 PM 锁，同样交给空闲循环
+void
+report_memory(void* payload) {
+    (void)payload;
+    report_pending = 1;
+}
+
+static struct pm_stats last_stats;
+
+void
+print_memory_report() {
+    struct pm_stats stats;
+    pmm_stats(&stats);
+
+    // 没有 libgcc，不能做 64 位除法：两者同时右移，直到周期数能放进 32 位
+    uint64_t cycles = stats.scan_cycles - last_stats.scan_cycles;
+    size_t scans = stats.scan_count - last_stats.scan_count;
+    while (cycles >> 32) {
+        cycles >>= 1;
+        scans >>= 1;
+    }
+
+    kprintf(KINFO "[MM] free: %u, cached: %u, used: %u, reserved: %u, offline: %u\n",
+           stats.free,
+           stats.cached,
+           stats.used,
+           stats.reserved,
+           stats.offline);
+    kprintf(KINFO "[MM] alloc: %u/s, free: %u/s, largest run: %u, scan: %u cycles\n",
+           (stats.alloc_pages - last_stats.alloc_pages) / MM_REPORT_PERIOD,
+           (stats.free_pages - last_stats.free_pages) / MM_REPORT_PERIOD,
+           stats.largest_run,
+           scans ? (uint32_t)cycles / scans : 0);
+    kprintf(KINFO "[MM] runs: %u %u %u %u %u %u %u %u %u %u %u\n",
+           stats.run_hist[0], stats.run_hist[1], stats.run_hist[2],
+           stats.run_hist[3], stats.run_hist[4], stats.run_hist[5],
+           stats.run_hist[6], stats.run_hist[7], stats.run_hist[8],
+           stats.run_hist[9], stats.run_hist[10]);
+
+    struct vmm_compact_stats cstats;
+    vmm_compact_stats(&cstats);
+    kprintf(KINFO "[MM] compact: %u/%u succeeded, %u migrated, %u failed\n",
+           cstats.succeeded,
+           cstats.attempts,
+           cstats.migrated,
+           cstats.failed);
+
+    last_stats = stats;
+}
+
+// 每个缓存行读取一个字节，遍历 base 处的 BENCH_COLOR_SIZE 字节 BENCH_COLOR_ROUNDS 次，
+//  返回除第一次（预热）外的总周期数
+static uint64_t
+__bench_line_walk(volatile uint8_t* base)
+{
+    for (size_t off = 0; off < BENCH_COLOR_SIZE; off += BENCH_COLOR_LINE) {
+        (void)base[off];
+    }
+
+    uint64_t begin = cpu_rdtsc();
+    for (int r = 0; r < BENCH_COLOR_ROUNDS; r++) {
+        for (size_t off = 0; off < BENCH_COLOR_SIZE; off += BENCH_COLOR_LINE) {
+            (void)base[off];
+        }
+    }
+    return cpu_rdtsc() - begin;
+}
+
+// 分别在开启与关闭页着色时分配同样大小的缓冲区，比较反复读取它的开销。
+// 关闭时物理页的颜色取决于分配顺序，部分缓存组会被过度使用，缓冲区接近 LLC 大小时更容易互相驱逐
+void
+bench_page_coloring() {
+    uint32_t saved = pmm_colors();
+    pmm_color_init(cpu_llc_way_size() >> PG_SIZE_BITS);
+    if (!pmm_colors()) {
+        kprintf(KWARN "[MM] page coloring bench skipped: LLC geometry unavailable\n");
+        pmm_color_init(saved);
+        return;
+    }
+    uint32_t colors = pmm_colors();
+
+    uint8_t* cbase = (uint8_t*)BENCH_CLONE_VADDR;
+    uint8_t* pbase = cbase + BENCH_COLOR_SIZE;
+    int ok = vmm_alloc_pages(cbase, BENCH_COLOR_SIZE, PG_PREM_RW);
+    pmm_color_init(0);
+    ok = ok && vmm_alloc_pages(pbase, BENCH_COLOR_SIZE, PG_PREM_RW);
+    pmm_color_init(saved);
+    if (!ok) {
+        kprintf(KWARN "[MM] page coloring bench skipped: cannot allocate %u MiB\n",
+               BENCH_COLOR_SIZE >> 20);
+        vmm_unmap_range(cbase, BENCH_COLOR_SIZE * 2);
+        return;
+    }
+
+    uint32_t pshift, cshift;
+    uint32_t pc = __cycles32(__bench_line_walk(pbase), &pshift);
+    uint32_t cc = __cycles32(__bench_line_walk(cbase), &cshift);
+
+    vmm_unmap_range(cbase, BENCH_COLOR_SIZE * 2);
+
+    kprintf(KINFO "[MM] read %u MiB x %u: uncolored %u << %u, colored (%u colors) %u << %u cycles\n",
+           BENCH_COLOR_SIZE >> 20, BENCH_COLOR_ROUNDS, pc, pshift,
+           colors, cc, cshift);
+}
+
+// 尝试分配 BENCH_FRAG_ATTEMPTS 个 2^BENCH_FRAG_ORDER 个页的块，compact 为真时每次失败后整理内存再试一次。
+//  返回成功的次数，失败的项为 NULL
+static uint32_t
+__bench_alloc_blocks(void** blocks, int compact)
+{
+    uint32_t ok = 0;
+    for (int i = 0; i < BENCH_FRAG_ATTEMPTS; i++) {
+        blocks[i] = pmm_alloc_pages(BENCH_FRAG_ORDER);
+        if (!blocks[i] && compact && vmm_compact(BENCH_FRAG_ORDER, ZONE_HIGH)) {
+            blocks[i] = pmm_alloc_pages(BENCH_FRAG_ORDER);
+        }
+        if (blocks[i]) {
+            ok++;
+        }
+    }
+    return ok;
+}
+
+static void
+__bench_free_blocks(void** blocks)
+{
+    for (int i = 0; i < BENCH_FRAG_ATTEMPTS; i++) {
+        if (blocks[i]) {
+            pmm_free_pages(blocks[i], BENCH_FRAG_ORDER);
+        }
+    }
+}
+
+// 逐页分配可迁移的页直到内存耗尽（或用完 BENCH_FRAG_SIZE 的地址空间），再每隔一页释放一个，
+//  使空闲内存碎片化。在同样的碎片化状态下，比较直接分配多页的块与失败后整理内存再分配的成功次数
+void
+bench_compaction() {
+    uint8_t* base = (uint8_t*)BENCH_CLONE_VADDR;
+    size_t pages = 0;
+    while (pages < (BENCH_FRAG_SIZE >> PG_SIZE_BITS) &&
+           vmm_alloc_pages(base + (pages << PG_SIZE_BITS), PG_SIZE, PG_PREM_RW)) {
+        pages++;
+    }
+    for (size_t i = 1; i < pages; i += 2) {
+        vmm_unmap_range(base + (i << PG_SIZE_BITS), PG_SIZE);
+    }
+
+    struct vmm_compact_stats before, after;
+    void* blocks[BENCH_FRAG_ATTEMPTS];
+
+    // 第一轮的块全部归还后，第二轮面对的是同样的碎片化状态
+    uint32_t direct = __bench_alloc_blocks(blocks, 0);
+    __bench_free_blocks(blocks);
+
+    vmm_compact_stats(&before);
+    uint32_t compacted = __bench_alloc_blocks(blocks, 1);
+    vmm_compact_stats(&after);
+    __bench_free_blocks(blocks);
+
+    vmm_unmap_range(base, pages << PG_SIZE_BITS);
+
+    kprintf(KINFO "[MM] order %u allocs after fragmenting %u pages: %u/%u direct, "
+           "%u/%u with compaction (%u pages migrated)\n",
+           BENCH_FRAG_ORDER, pages,
+           direct, BENCH_FRAG_ATTEMPTS,
+           compacted, BENCH_FRAG_ATTEMPTS,
+           after.migrated - before.migrated);
+}
+
+// 比较逐页映射、解除映射（每页一次 invlpg）与 vmm_map_range / vmm_unmount_range
+//  （每个页表只查找一次，最后统一刷新 TLB）映射同样大小的区域的开销
+void
+bench_map_range() {
+    uint8_t* base = (uint8_t*)BENCH_CLONE_VADDR;
+    // 页表预先分配好，两种方式都不计入分配页表的开销
+    if (!vmm_alloc_tables(base, BENCH_MAP_SIZE)) {
+        kprintf(KWARN "[MM] map range bench skipped: cannot allocate page tables\n");
+        return;
+    }
+
+    uint64_t begin = cpu_rdtsc();
+    for (size_t off = 0; off < BENCH_MAP_SIZE; off += PG_SIZE) {
+        vmm_set_mapping(base + off, (void*)(BENCH_MAP_PADDR + off), PG_PREM_RW);
+    }
+    for (size_t off = 0; off < BENCH_MAP_SIZE; off += PG_SIZE) {
+        vmm_unmount_page(base + off);
+    }
+    uint64_t page_cycles = cpu_rdtsc() - begin;
+
+    begin = cpu_rdtsc();
+    vmm_map_range(base, BENCH_MAP_PADDR, BENCH_MAP_SIZE, PG_PREM_RW);
+    vmm_unmount_range(base, BENCH_MAP_SIZE);
+    uint64_t range_cycles = cpu_rdtsc() - begin;
+
+    uint32_t pshift, rshift;
+    uint32_t pc = __cycles32(page_cycles, &pshift);
+    uint32_t rc = __cycles32(range_cycles, &rshift);
+    kprintf(KINFO "[MM] map+unmap %u MiB: per page %u << %u, batched %u << %u cycles\n",
+           BENCH_MAP_SIZE >> 20, pc, pshift, rc, rshift);
+}
@@ -0,0 +1,150 @@
+#include <awa/mm/compact.h>
+#include <awa/mm/page.h>
+#include <awa/mm/pmm.h>
+#include <awa/mm/vmm.h>
+#include <awa/common.h>
+
+#include <klibc/string.h>
+
+#include <hal/cpu.h>
+
+#include <stdbool.h>
+
+static struct vmm_compact_stats compact_stats;
+
+// 被整理的块中每个页被页表项引用的次数，饱和于 2（只关心是否恰好为 1）
+static uint8_t compact_refs[1U << PM_MAX_ORDER];
+
+// 以 4 字节为单位复制一个页
+static inline void
+__vmm_copy_page(void* dst, void* src)
+{
+    uint32_t count = PG_SIZE / sizeof(uint32_t);
+    asm volatile("rep movsl"
+                 : "+D"(dst), "+S"(src), "+c"(count)
+                 :
+                 : "memory");
+}
+
+// 把映射在 V_ADDR(l1_index, l2_index, 0) 上的物理页迁移到一个新的物理页，要求中断已关闭
+static int
+__vmm_migrate(uint32_t l1_index, uint32_t l2_index)
+{
+    x86_page_table* l2pt = (x86_page_table*)L2_VADDR(l1_index);
+    x86_pte_t l2pte = l2pt->entry[l2_index];
+    void* va = (void*)V_ADDR(l1_index, l2_index, 0);
+    struct pm_page* sp = pmm_frame(PG_ENTRY_PPN(l2pte));
+    if (!sp || sp->type != PP_KERNEL || !(sp->flags & PP_FL_MOVABLE)) {
+        return 0;
+    }
+
+    // 块已被隔离，新的页一定在块外
+    void* dst = pmm_alloc_page();
+    if (!dst) {
+        return 0;
+    }
+
+    // 新页在直接映射区中时无需挂载
+    void* win = phys_to_virt((uintptr_t)dst);
+    if (win) {
+        __vmm_copy_page(win, va);
+    } else {
+        win = vmm_mount_page((void*)PG_MOUNT_1, dst);
+        if (!win) {
+            pmm_free_page(dst);
+            return 0;
+        }
+        __vmm_copy_page(win, va);
+        vmm_unmount_page(win);
+    }
+
+    // 中断已关闭，复制之后没有人能再写入旧页
+    l2pt->entry[l2_index] = NEW_L2_ENTRY(PG_ENTRY_FLAGS(l2pte), dst);
+    cpu_invplg(va);
+
+    // 描述符随页迁移，旧页成为 PP_FREE，由 pmm_compact_release 归还
+    *pmm_page(dst) = *sp;
+    *sp = (struct pm_page){ .type = PP_FREE };
+    return 1;
+}
+
+// 反向映射：借助递归映射遍历所有页表，找出引用了 [lo, hi) 中物理页的页表项。
+// 递归映射区域本身跳过；直接映射区（没有大页时由 4KiB 页组成）映射的是所有物理页，
+//  并不是页的所有者，迁移它会让真正的所有者的页表项无法再被迁移。
+// migrate 为 false 时只统计引用次数，为 true 时迁移恰好被引用一次的页
+static void
+__vmm_compact_walk(paddr_t lo, paddr_t hi, bool migrate)
+{
+    if (!migrate) {
+        memset(compact_refs, 0, sizeof(compact_refs));
+    }
+
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR;
+    for (uint32_t i = 0; i < PG_L1_RECURSIVE; i++) {
+        if (i >= L1_INDEX(HIGHER_HLF_BASE) && i < L1_INDEX(K_DIRECT_MAP_END)) {
+            continue;
+        }
+        x86_pte_t l1pte = l1pt->entry[i];
+        if (!IS_CACHED(l1pte) || IS_LARGE_PDE(l1pte)) {
+            continue;
+        }
+
+        x86_page_table* l2pt = (x86_page_table*)L2_VADDR(i);
+        for (uint32_t j = 0; j < PG_MAX_ENTRIES; j++) {
+            x86_pte_t l2pte = l2pt->entry[j];
+            paddr_t pa = PG_ENTRY_ADDR(l2pte);
+            if (!IS_CACHED(l2pte) || pa < lo || pa >= hi) {
+                continue;
+            }
+
+            uint8_t* refs = &compact_refs[(pa - lo) >> PG_SIZE_BITS];
+            if (!migrate) {
+                if (*refs < 2) {
+                    (*refs)++;
+                }
+                continue;
+            }
+
+            if (*refs == 1 && __vmm_migrate(i, j)) {
+                compact_stats.migrated++;
+            } else {
+                compact_stats.failed++;
+            }
+        }
+    }
+}
+
+int
+vmm_compact(uint32_t order, int zone)
+{
+    reg32 eflags = cpu_disable_interrupt_save();
+    compact_stats.attempts++;
+
+    void* block = pmm_compact_isolate(order, zone);
+    if (!block) {
+        cpu_restore_interrupt(eflags);
+        return 0;
+    }
+
+    paddr_t lo = (uintptr_t)block;
+    paddr_t hi = lo + ((uintptr_t)PG_SIZE << order);
+
+    // 同一物理页可能被映射了不止一次（例如别名映射），这时迁移只会改写其中一个页表项，
+    //  其余的仍然指向旧页，而旧页随后被释放。所以先数一遍引用，只迁移恰好被引用一次的页
+    __vmm_compact_walk(lo, hi, false);
+    __vmm_compact_walk(lo, hi, true);
+
+    int whole = pmm_compact_release(block, order);
+    compact_stats.succeeded += whole;
+
+    cpu_restore_interrupt(eflags);
+    return whole;
+}
+
+void
+vmm_compact_stats(struct vmm_compact_stats* stats)
+{
+    reg32 eflags = cpu_disable_interrupt_save();
+    *stats = compact_stats;
+    cpu_restore_interrupt(eflags);
+}
@@ -27,7 +27,9 @@ dmm_init(heap_context_t* heap)
 
     heap->brk = heap->start;
 
-    return vmm_alloc_page(heap->brk, PG_PREM_RW) != NULL;
+    // 整个堆只保留虚拟地址，页在首次访问时才分配。
+    // 这些页总是全零的，brk 之后的内存在被使用之前也就一直是零
+    return vmm_lazy_add(heap->start, heap->max_addr - heap->start, PG_PREM_RW);
 }
 
 int
@@ -46,7 +48,6 @@ lxbrk(heap_context_t* heap, size_t size)
     void* current_brk = heap->brk;
 
     // The upper bound of our next brk of heap given the size.
-    // This will be used to calculate the page we need to allocate.
     void* next = current_brk + ROUNDUP(size, BOUNDARY);
 
     // any invalid situations
@@ -54,18 +55,7 @@ lxbrk(heap_context_t* heap, size_t size)
         return NULL;
     }
 
-    uintptr_t diff = PG_ALIGN(next) - PG_ALIGN(current_brk);
-    if (diff) {
-        // if next do require new pages to be allocated
-        if (!vmm_alloc_pages((void*)(PG_ALIGN(current_brk) + PG_SIZE),
-                             diff,
-                             PG_PREM_RW)) {
-            // for debugging
-            assert_msg(0, "unable to brk");
-            return NULL;
-        }
-    }
-
+    // 新的页由缺页处理按需分配（见 dmm_init），这里只需移动 brk
     heap->brk += size;
     return current_brk;
 }
@@ -0,0 +1,165 @@
+#include <awa/mm/ioremap.h>
+#include <awa/mm/page.h>
+#include <awa/mm/vmm.h>
+#include <awa/common.h>
+#include <awa/spike.h>
+
+#include <hal/cpu.h>
+
+/*
+ * MMIO 映射
+ *
+ * 地址取自内核虚拟区域（vmm_reserve_range），映射的物理页不归 PMM 所有，解除时不释放。
+ * 同一段物理地址常被多个驱动（或同一驱动多次）映射，完全包含在已有映射中、内存类型相同的请求
+ *  共享该映射，只增加引用计数。
+ * 映射不多，用一个小数组记录就够了。
+ */
+#define IOREMAP_MAX     64
+
+struct io_mapping
+{
+    paddr_t pa;             // 映射的物理地址，页对齐
+    size_t size;            // 字节数，页对齐
+    uintptr_t va;           // pa 对应的虚拟地址
+    uintptr_t area;         // vmm_reserve_range 保留的地址，大的映射按大页对齐，可能在 va 之前
+    size_t area_size;
+    pt_attr memtype;
+    uint32_t ref_count;     // 为 0 即空闲的槽位
+};
+
+static struct io_mapping io_maps[IOREMAP_MAX];
+
+static struct io_mapping*
+__ioremap_find(uintptr_t va)
+{
+    for (size_t i = 0; i < IOREMAP_MAX; i++) {
+        struct io_mapping* m = &io_maps[i];
+        if (m->ref_count && va >= m->va && va - m->va < m->size) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+void*
+ioremap(paddr_t pa, size_t size, pt_attr memtype)
+{
+    if (!size) {
+        return NULL;
+    }
+
+    memtype &= PG_MEM_MASK;
+    paddr_t start = pa & ~(paddr_t)(PG_SIZE - 1);
+    paddr_t end = ROUNDUP(pa + size, (paddr_t)PG_SIZE);
+    size_t len = (size_t)(end - start);
+
+    reg32 eflags = cpu_disable_interrupt_save();
+
+    struct io_mapping* slot = NULL;
+    for (size_t i = 0; i < IOREMAP_MAX; i++) {
+        struct io_mapping* m = &io_maps[i];
+        if (!m->ref_count) {
+            slot = slot ? slot : m;
+            continue;
+        }
+        if (end <= m->pa || start >= m->pa + m->size) {
+            continue;
+        }
+
+        // 同一物理地址以不同的内存类型映射，结果是未定义的
+        if (m->memtype != memtype) {
+            cpu_restore_interrupt(eflags);
+            return NULL;
+        }
+        if (start >= m->pa && end <= m->pa + m->size) {
+            m->ref_count++;
+            cpu_restore_interrupt(eflags);
+            return (void*)(m->va + (uintptr_t)(pa - m->pa));
+        }
+    }
+    if (!slot) {
+        cpu_restore_interrupt(eflags);
+        return NULL;
+    }
+
+    // 大的映射按大页对齐保留地址，使虚拟地址与物理地址在大页内的偏移相同，
+    //  其中完整覆盖了一个大页的部分才能以大页映射。它们留到首次访问时再映射（见 ioremap_fault）
+    int lazy = len >= PG_LARGE_SIZE;
+    size_t lead = lazy ? (size_t)(start & (PG_LARGE_SIZE - 1)) : 0;
+    size_t area_size = lazy ? ROUNDUP(lead + len, PG_LARGE_SIZE) : len;
+    void* area = vmm_reserve_range(area_size, lazy ? PG_LARGE_SIZE : PG_SIZE);
+    if (!area) {
+        cpu_restore_interrupt(eflags);
+        return NULL;
+    }
+
+    uintptr_t va = (uintptr_t)area + lead;
+    if (!lazy && !vmm_map_range((void*)va, start, len, PG_PREM_RW | memtype)) {
+        vmm_unmount_range((void*)va, len);
+        vmm_release_range(area);
+        cpu_restore_interrupt(eflags);
+        return NULL;
+    }
+
+    *slot = (struct io_mapping){
+        .pa = start,
+        .size = len,
+        .va = va,
+        .area = (uintptr_t)area,
+        .area_size = area_size,
+        .memtype = memtype,
+        .ref_count = 1,
+    };
+
+    cpu_restore_interrupt(eflags);
+    return (void*)(va + (uintptr_t)(pa - start));
+}
+
+void
+iounmap(void* va)
+{
+    reg32 eflags = cpu_disable_interrupt_save();
+
+    struct io_mapping* m = __ioremap_find((uintptr_t)va);
+    if (m && !--m->ref_count) {
+        vmm_unmount_range((void*)m->area, m->area_size);
+        vmm_release_range((void*)m->area);
+    }
+
+    cpu_restore_interrupt(eflags);
+}
+
+int
+ioremap_fault(void* va)
+{
+    uintptr_t v = (uintptr_t)va;
+    if (v < K_VAREA_START || v >= K_VAREA_END) {
+        return 0;
+    }
+
+    reg32 eflags = cpu_disable_interrupt_save();
+
+    struct io_mapping* m = __ioremap_find(v);
+    if (!m) {
+        cpu_restore_interrupt(eflags);
+        return 0;
+    }
+
+    // 一次映射 va 所在的整个大页：完整地落在映射中时使用大页，否则（首尾未对齐的部分，
+    //  或者处理器不支持大页）以 4KiB 页映射其中属于该映射的部分
+    pt_attr attr = PG_PREM_RW | m->memtype;
+    uintptr_t from = v & ~(PG_LARGE_SIZE - 1);
+    uintptr_t to = from + PG_LARGE_SIZE;
+    int done = 0;
+    if (from >= m->va && to <= m->va + m->size) {
+        done = vmm_map_large_page((void*)from, m->pa + (from - m->va), attr) != NULL;
+    }
+    if (!done) {
+        from = from > m->va ? from : m->va;
+        to = to < m->va + m->size ? to : m->va + m->size;
+        done = vmm_map_range((void*)from, m->pa + (from - m->va), to - from, attr);
+    }
+
+    cpu_restore_interrupt(eflags);
+    return done;
+}
@@ -21,8 +21,6 @@
 
 #include <stdint.h>
 
-extern uint8_t __kernel_heap_start;
-
 static heap_context_t __kalloc_kheap;
 
 void*
@@ -61,9 +59,10 @@ lx_grow_heap(heap_context_t* heap, size_t sz);
 
 int
 kalloc_init() {
-    __kalloc_kheap.start = &__kernel_heap_start;
+    // 堆紧接在直接映射区之后
+    __kalloc_kheap.start = (void*)K_HEAP_START;
     __kalloc_kheap.brk = NULL;
-    __kalloc_kheap.max_addr = (void*)K_STACK_START;
+    __kalloc_kheap.max_addr = (void*)K_HEAP_END;
 
     if (!dmm_init(&__kalloc_kheap)) {
         return 0;
@@ -90,12 +89,22 @@ lxcalloc(size_t n, size_t elem) {
         return NULL;
     }
 
+    // brk 之后的内存来自全零的页，且从未被使用过（见 dmm_init）
+    uint8_t* clean = (uint8_t*)__kalloc_kheap.brk + WSIZE;
+
     void* ptr = lxmalloc(pd);
     if (!ptr) {
         return NULL;
     }
 
-    return memset(ptr, 0, pd);
+    if ((uint8_t*)ptr < clean) {
+        return memset(ptr, 0, pd);
+    }
+
+    // 这个块是堆扩展时新得到的，除了扩展时写入的脚部（恰好填满时位于块的末尾）外全为零
+    uint8_t* chunk_ptr = (uint8_t*)ptr - WSIZE;
+    SW(FPTR(chunk_ptr, CHUNK_S(LW(chunk_ptr))), 0);
+    return ptr;
 }
 
 void
@@ -0,0 +1,210 @@
+#include <awa/mm/memblock.h>
+#include <awa/mm/page.h>
+#include <awa/mm/pmm.h>
+#include <awa/mm/vmm.h>
+#include <awa/common.h>
+#include <awa/spike.h>
+
+#include <klibc/string.h>
+
+
+/*
+ * memblock
+ *
+ * 在 PMM 与堆之前工作的区间分配器：可用的物理内存记录为按地址排列的区间 [start, end)，
+ * 分配时从最低的区间切下一段（first fit），预留即从区间中挖去一段。
+ * 早期分配的内存都在 MEMBLOCK_LIMIT 之下，经由直接映射区（见 vmm_init_direct_map）访问；
+ *  直接映射区本身所需的页表则用 memblock_alloc_phys 分配。
+ * PMM 的元数据（位图、伙伴树）就从这里按实际的内存大小分配，分配完毕后，
+ *  剩余的区间经由 memblock_handover 交给 PMM，此后一切分配都走 PMM。
+ */
+struct memblock_region
+{
+    paddr_t start;
+    paddr_t end;
+};
+
+static struct memblock_region mb_regions[MEMBLOCK_REGIONS_MAX];
+static uint32_t mb_count;
+
+// 可用内存的最高页号（不含），即 PMM 需要管理的页数
+static uintptr_t mb_max_pfn;
+
+static int mb_done;
+
+static void
+__mb_remove(uint32_t i)
+{
+    for (; i + 1 < mb_count; i++) {
+        mb_regions[i] = mb_regions[i + 1];
+    }
+    mb_count--;
+}
+
+static void
+__mb_insert(uint32_t i, paddr_t start, paddr_t end)
+{
+    if (mb_count == MEMBLOCK_REGIONS_MAX) {
+        return;
+    }
+    for (uint32_t j = mb_count; j > i; j--) {
+        mb_regions[j] = mb_regions[j - 1];
+    }
+    mb_regions[i] = (struct memblock_region){ start, end };
+    mb_count++;
+}
+
+static void
+__mb_add(paddr_t start, paddr_t end)
+{
+    start = ROUNDUP(start, PG_SIZE);
+    end = ROUNDDOWN(end, PG_SIZE);
+    if (start >= end) {
+        return;
+    }
+    if (end >> PG_SIZE_BITS > mb_max_pfn) {
+        mb_max_pfn = end >> PG_SIZE_BITS;
+    }
+
+    uint32_t i = 0;
+    while (i < mb_count && mb_regions[i].start < start) {
+        i++;
+    }
+    __mb_insert(i, start, end);
+}
+
+void
+memblock_reserve(paddr_t start, paddr_t end)
+{
+    start = ROUNDDOWN(start, PG_SIZE);
+    end = ROUNDUP(end, PG_SIZE);
+
+    for (uint32_t i = 0; i < mb_count;) {
+        struct memblock_region* r = &mb_regions[i];
+        if (r->end <= start || r->start >= end) {
+            i++;
+            continue;
+        }
+
+        // 挖去中间的一段，区间一分为二
+        if (r->start < start && r->end > end) {
+            __mb_insert(i + 1, end, r->end);
+            r->end = start;
+            return;
+        }
+
+        if (r->start >= start && r->end <= end) {
+            __mb_remove(i);
+            continue;
+        }
+        if (r->start < start) {
+            r->end = start;
+        } else {
+            r->start = end;
+        }
+        i++;
+    }
+}
+
+void
+memblock_init(multiboot_memory_map_t* map, size_t map_size, uintptr_t reserved_end)
+{
+    mb_count = 0;
+    mb_max_pfn = 0;
+    mb_done = 0;
+
+    for (size_t i = 0; i < map_size; i++) {
+        if (map[i].type != MULTIBOOT_MEMORY_AVAILABLE) {
+            continue;
+        }
+#ifdef CONFIG_PAE
+        // PAE 下 4GiB 以上的内存同样可用，但不超过 PMM 能够管理的范围
+        paddr_t start = ((paddr_t)map[i].addr_high << 32) | map[i].addr_low;
+        paddr_t end = start + (((paddr_t)map[i].len_high << 32) | map[i].len_low);
+        if (end > (paddr_t)PM_MAX_PAGES << PG_SIZE_BITS) {
+            end = (paddr_t)PM_MAX_PAGES << PG_SIZE_BITS;
+        }
+        __mb_add(start, end);
+#else
+        // 4GiB 以上的内存我们用不到
+        if (map[i].addr_high) {
+            continue;
+        }
+        uintptr_t end = map[i].addr_low + map[i].len_low;
+        if (map[i].len_high || end < map[i].addr_low) {
+            end = 0xFFFFF000U;
+        }
+        __mb_add(map[i].addr_low, end);
+#endif
+    }
+
+    memblock_reserve(0, reserved_end);
+    memblock_reserve(VGA_BUFFER_PADDR, VGA_BUFFER_PADDR + VGA_BUFFER_SIZE);
+}
+
+// 从可用区间中切下一段，返回其物理地址，没有则返回 0
+static paddr_t
+__mb_take(size_t size, size_t align)
+{
+    for (uint32_t i = 0; i < mb_count; i++) {
+        paddr_t start = ROUNDUP(mb_regions[i].start, (paddr_t)align);
+        paddr_t end = start + size;
+        if (end > mb_regions[i].end || end > MEMBLOCK_LIMIT || end < start) {
+            continue;
+        }
+        memblock_reserve(start, end);
+        return start;
+    }
+    return 0;
+}
+
+paddr_t
+memblock_alloc_phys(size_t size, size_t align)
+{
+    if (mb_done || !size) {
+        return 0;
+    }
+
+    size = ROUNDUP(size, PG_SIZE);
+    align = align > PG_SIZE ? align : PG_SIZE;
+    return __mb_take(size, align);
+}
+
+void*
+memblock_alloc(size_t size, size_t align)
+{
+    // 在 MEMBLOCK_LIMIT 之下，可以用 uintptr_t 表示
+    uintptr_t pa = memblock_alloc_phys(size, align);
+    if (!pa) {
+        return NULL;
+    }
+
+    void* va = phys_to_virt(pa);
+    memset(va, 0, ROUNDUP(size, PG_SIZE));
+    return va;
+}
+
+size_t
+memblock_handover(size_t* regions)
+{
+    size_t pages = 0;
+    for (uint32_t i = 0; i < mb_count; i++) {
+        size_t n = (mb_regions[i].end - mb_regions[i].start) >> PG_SIZE_BITS;
+        pmm_defer_chunk_free(mb_regions[i].start >> PG_SIZE_BITS, n);
+        pages += n;
+    }
+
+    if (regions) {
+        *regions = mb_count;
+    }
+    mb_count = 0;
+    mb_done = 1;
+    return pages;
+}
+
+uintptr_t
+memblock_max_pfn()
+{
+    return mb_max_pfn;
+}
+
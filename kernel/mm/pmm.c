@@ -1,24 +1,26 @@
 #include <awa/mm/page.h>
 #include <awa/mm/pmm.h>
+#include <awa/mm/memblock.h>
+#include <awa/mm/vmm.h>
+#include <awa/common.h>
+#include <awa/spinlock.h>
+#include <awa/spike.h>
+
+#include <klibc/string.h>
+
+#include <hal/cpu.h>
 
 //ppn("Physical Page Number") 即 物理页号
 //标记 单个物理页(page)
 #define MARK_PG_AUX_VAR(ppn)                                                   \
-    uint32_t group = ppn / 8;                                                  \
-    uint32_t msk = (0x80U >> (ppn % 8));                                       \
-//0x80 ==> 1000 0000
-//当ppn % 8 == 0时，即不需要位移，刚好在第八位
-//直接使用即可
+    uint32_t group = ppn / PM_BMP_WORD_BITS;                                   \
+    uint32_t msk = (1U << (ppn % PM_BMP_WORD_BITS));
+//位图以 32 位的字为单位，第 ppn 个页位于 pm_bitmap[ppn / 32] 的第 (ppn % 32) 位
+//即低位在前，这样可以直接使用 bsf (__builtin_ctz) 找到字中第一个空闲页
 
-//ppn("Physical Page Number") 即 物理页号
-//连续标记 多个物理页(chunk)
-#define MARK_CHUNK_AUX_VAR(start_ppn, page_count)                              \
-    uint32_t group = start_ppn / 8;                                            \
-    uint32_t offset = start_ppn % 8;                                           \
-    uint32_t group_count = (page_count + offset) / 8;                          \
-    uint32_t remainder = (page_count + offset) % 8;                            \
-    uint32_t leading_shifts =                                                  \
-      (page_count + offset) < 8 ? page_count : 8 - offset;
+// 字中 [offset, offset + count) 的位，要求 offset + count <= 32
+#define PM_RUN_MASK(offset, count)                                             \
+    (((count) >= PM_BMP_WORD_BITS ? ~0U : ((1U << (count)) - 1)) << (offset))
 
 /*
  * 位图: 用于标记 物理页 的 "状态"
@@ -27,30 +29,522 @@
  *      3. 预留(高级情况下可能会用到)
 */
 
-// 位图数组，用于记录 物理页 的 状态
-static uint8_t pm_bitmap[PM_BMP_MAX_SIZE];
+// 位图数组，用于记录 物理页 的 状态。由 pmm_init 按内存大小从 memblock 中分配
+static uint32_t* pm_bitmap;
 
 // 最大的物理页编号
 static uintptr_t max_pg;
 
+// 物理页描述符数组，下标即物理页号，在 pmm_init_pages 之前为 NULL。
+// 数组只保留了地址，[0, pm_pages_end) 的描述符随内存上线才映射（见 __pm_pages_grow）
+static struct pm_page* pm_pages;
+static uintptr_t pm_pages_end;
+
+#define PM_PAGE(ppn)    (pm_pages && (ppn) < pm_pages_end ? &pm_pages[ppn] : NULL)
+
+/*
+ * 内存区域（Zone）
+ *
+ *      ZONE_DMA        [0, 16MiB)          ISA DMA 只能访问低 16MiB
+ *      ZONE_NORMAL     [16MiB, 768MiB)     可被内核长期映射的低端内存
+ *      ZONE_HIGH       [768MiB, 4GiB)
+ *      ZONE_PAE        [4GiB, max_pg)      仅 PAE，只有以物理页号表示的接口（pmm_alloc_frame 等）使用
+ *
+ * 以 void* 表示物理地址的接口只在 ZONE_HIGH 及以下分配，并且 per-CPU 页缓存中也只存放这些页。
+ * 每个区域都有自己的 next-fit 指针、空闲页计数与水位。只有 ZONE_DMA 有水位：
+ *  其他区域是普通分配本来就该用的内存，给它们设水位只会让较小的机器（没有 ZONE_HIGH，
+ *  或 PAE 下没有 ZONE_PAE）白白浪费一部分内存。
+ */
+static struct pm_zone pm_zones[PM_ZONE_COUNT] = {
+    [ZONE_DMA] = { .name = "DMA" },
+    [ZONE_NORMAL] = { .name = "Normal" },
+    [ZONE_HIGH] = { .name = "High" },
+#ifdef CONFIG_PAE
+    [ZONE_PAE] = { .name = "PAE" },
+#endif
+};
+
+// 以物理页号分配时的起始区域，即最高的区域
+#define PM_ZONE_FRAME           (PM_ZONE_COUNT - 1)
+
+// 普通分配回落到 ZONE_DMA 后，至少为驱动保留其空闲页的 1/8
+#define PM_ZONE_WMARK_SHIFT     3
+
+/*
+ * 延迟上线
+ *
+ * 启动时只有 [0, PM_ONLINE_EARLY_END) 中的可用内存被立即标注为空闲，
+ * 其余的可用区域先记录在 pm_deferred 中，之后按地址顺序每次上线 PM_ONLINE_CHUNK 个页：
+ *      分配失败时就地上线一块再重试（懒惰），或者由空闲循环逐块上线。
+ * [0, pm_online_end) 中的内存都已上线。这样启动时间就不再随内存大小增长。
+ */
+#define PM_ONLINE_EARLY_END     ((32UL << 20) >> 12)
+#define PM_ONLINE_CHUNK         1024        // 4MiB，与区域之间的边界对齐
+#define PM_DEFERRED_MAX         32
+
+static struct
+{
+    uintptr_t start;
+    uintptr_t end;
+} pm_deferred[PM_DEFERRED_MAX];
+
+static uint32_t pm_deferred_count;
+static uintptr_t pm_online_end;
+
+/*
+ * NUMA 节点
+ *
+ * 物理内存以 4MiB 为单位（恰好是一个 l1 摘要字所覆盖的范围）划分给各个节点，
+ *  pm_chunk_node 记录每一块所属的节点。所有节点共用同一个位图与索引，
+ *  但各自统计空闲页与分配次数。
+ * 每个节点都有一张按 SLIT 距离由近及远排列的窗口表：先是本节点的内存，然后是最近的节点……
+ *  分配时按窗口依次在 [start, end) 中查找，于是总是优先使用本节点的内存。
+ * 没有 SRAT 时只有节点 0，它唯一的窗口覆盖全部内存。
+ */
+#define PM_NODE_CHUNK_PAGES     (PM_BMP_WORD_BITS * PM_BMP_WORD_BITS)
+#define PM_NODE_CHUNKS          (PM_BMP_WORDS / PM_BMP_WORD_BITS)
+#define PM_NODE_WINDOWS         32
+
+struct pm_window
+{
+    uintptr_t start;
+    uintptr_t end;
+    uint32_t node;
+};
+
+static struct pm_node pm_nodes[PM_NODE_MAX];
+static uint32_t pm_node_count = 1;
+static uint32_t pm_node_assigned;
+static uint8_t pm_chunk_node[PM_NODE_CHUNKS];
+
+static struct
+{
+    uint32_t count;
+    struct pm_window win[PM_NODE_WINDOWS];
+} pm_node_windows[PM_NODE_MAX];
+
+static uint8_t pm_cpu_node[CPU_MAX];
+
+/*
+ * 页着色（Page Coloring）
+ *
+ * 物理索引的缓存中，物理页号除以颜色数的余数（颜色）决定了页落在缓存的哪些组上。
+ * 颜色数 = LLC 每一路的大小 / 页大小。按地址顺序分配时，一段缓冲区的颜色分布取决于碰巧拿到的页，
+ *  可能集中在少数几种颜色上而互相挤占缓存。开启页着色后，vmm_alloc_pages 为第 k 个虚拟页
+ *  分配颜色为 k 的物理页，于是虚拟地址连续的缓冲区均匀地分布在所有的组上。
+ * pm_colors 为 0 时页着色关闭。
+ */
+#define PM_COLOR_ANY            (~0U)
+
+static uint32_t pm_colors;
+
+// 取出位图中第 group 个字所对应的 32 个页的空闲掩码，1 表示空闲
+static uint32_t
+__pm_word_free_mask(uint32_t group)
+{
+    uintptr_t base = group * PM_BMP_WORD_BITS;
+    if (base >= max_pg) {
+        return 0;
+    }
+
+    uint32_t msk = ~pm_bitmap[group];
+
+    // 与 pmm_alloc_page 一样，永远不分配位于0x0的页
+    if (!group) {
+        msk &= ~1U;
+    }
+
+    // 超出 max_pg 的页不可分配
+    if (max_pg - base < PM_BMP_WORD_BITS) {
+        msk &= (1U << (max_pg - base)) - 1;
+    }
+    return msk;
+}
+
+/*
+ * 空闲页索引（Summary Bitmap）
+ *
+ * 在 pm_bitmap 之上再建立两级摘要位图，用于在内存几乎耗尽时也能快速找到空闲页：
+ *      pm_summary_l1 的第 g 位    : pm_bitmap[g] 中至少有一个空闲页（每个字覆盖 1024 个页）
+ *      pm_summary_l2 的第 w 位    : pm_summary_l1[w] 不为 0（每个字覆盖 32768 个页）
+ * 查找时依次读取 l2 -> l1 -> pm_bitmap，读取的字数有上界，与内存占用率无关。
+ * 摘要随每次 pmm_mark_* 增量更新。
+ */
+#define PM_SUMMARY_L1_WORDS     (PM_BMP_WORDS / PM_BMP_WORD_BITS)
+#define PM_SUMMARY_L2_WORDS     (PM_SUMMARY_L1_WORDS / PM_BMP_WORD_BITS)
+
+static uint32_t pm_summary_l1[PM_SUMMARY_L1_WORDS];
+static uint32_t pm_summary_l2[PM_SUMMARY_L2_WORDS];
+
+/*
+ * 伙伴系统（Buddy System）
+ *
+ * 伙伴系统并不另外维护一份空闲链表，而是在 pm_bitmap 之上建立一棵完全二叉树：
+ * 每个节点覆盖 2^k 个物理页，节点的值记录了其覆盖范围内 最大的、对齐的空闲块的阶（order）。
+ *      0       : 范围内没有空闲页
+ *      k + 1   : 范围内存在一个 2^k 个页的对齐空闲块
+ * 若左右两个伙伴都完全空闲，则父节点也完全空闲（即隐式的合并）。
+ *
+ * 叶子节点对应位图中的一个字（32 个页），所以树的大小只有位图的一半。
+ * 位图依旧是唯一的真实状态，所有 pmm_mark_* 都会顺带更新这棵树，
+ * 因此 setup_memory() 等现有代码无需任何改动。
+ *
+ *              [root]                  阶 5 + log2(叶子数)，4GiB 内存时为 20
+ *             /      \
+ *          [..]      [..]
+ *           ...       ...
+ *      [leaf] [leaf] [leaf] ...        阶 5 (128KiB) <==> pm_bitmap[i]
+ */
+#define PM_BUDDY_LEAF_ORDER     5
+#define PM_BUDDY_MIN_LEAVES     32          // 至少覆盖 4MiB，使根节点不小于 PM_MAX_ORDER
+
+// 叶子数为不小于位图字数的 2 的幂，树与位图都由 pmm_init 按内存大小分配
+static uint32_t pm_buddy_leaves;
+static uint32_t pm_buddy_root_order;
+static uint8_t* pm_buddy_tree;
+
+// 用于逐级合并叶子内的伙伴：第 i 步后，2^(i+1) 对齐处的位表示该块是否完全空闲
+static const uint32_t pm_buddy_pair_msk[PM_BUDDY_LEAF_ORDER] = {
+    0x55555555U, 0x11111111U, 0x01010101U, 0x00010001U, 0x00000001U
+};
+
+// 位图中 [start_ppn, start_ppn + page_count) 发生了变化，刷新其上的摘要位图与伙伴树
+static void
+__pm_index_update(uintptr_t start_ppn, size_t page_count);
+
+/*
+ * 页缓存（Magazine）
+ *
+ * 每个处理器在位图之前拥有一个小的 LIFO 页缓存：
+ *      pmm_free_page 把页压入缓存顶部，pmm_alloc_page 优先从顶部取出，
+ *      所以刚释放的（很可能还在CPU缓存里的）页会被最先重用，而且完全不用访问位图。
+ * 缓存为空时，一次从位图中取出 PM_MAG_BATCH 个页；
+ * 缓存已满时，一次把底部（最冷的）PM_MAG_BATCH 个页归还给位图。
+ * 缓存中的页在位图中依然是 [已占用]。
+ *
+ * 访问自己的缓存只需关闭本处理器的中断，访问位图及其索引则必须持有 pm_lock。
+ */
+#define PM_MAG_SIZE     64
+#define PM_MAG_BATCH    32
+
+struct pm_magazine
+{
+    uint32_t count;
+    uintptr_t frames[PM_MAG_SIZE]; // 物理页号
+};
+
+static struct pm_magazine pm_magazines[CPU_MAX];
+
+/*
+ * 统计
+ *
+ * 分配与释放的页数按处理器分别累计，只由本处理器在关闭中断时修改，不需要原子操作；
+ * 查找耗时（TSC 周期）与预留页数在 pm_lock 之下修改。
+ */
+struct pm_cpu_stats
+{
+    size_t alloc_pages;
+    size_t free_pages;
+};
+
+static struct pm_cpu_stats pm_cpu_stats[CPU_MAX];
+
+// 要求中断已关闭
+#define PM_COUNT(field, n)      (pm_cpu_stats[cpu_id()].field += (n))
+
+static uint64_t pm_scan_cycles;
+static size_t pm_scan_count;
+static size_t pm_reserved_count;
+
+static spinlock_t pm_lock = SPINLOCK_INIT;
+
+#define PM_LOCK(eflags)                                                        \
+    eflags = cpu_disable_interrupt_save();                                     \
+    spinlock_acquire(&pm_lock);
+
+#define PM_UNLOCK(eflags)                                                      \
+    spinlock_release(&pm_lock);                                                \
+    cpu_restore_interrupt(eflags);
+
 //  ... |xxxx xxxx |
 //  ... |-->|
 
+// 以下 __pm_* 函数均要求调用者持有 pm_lock
+
+static struct pm_zone*
+__pm_zone_of(uintptr_t ppn)
+{
+    for (int i = 0; i < PM_ZONE_COUNT; i++) {
+        if (ppn >= pm_zones[i].start_pg && ppn < pm_zones[i].end_pg) {
+            return &pm_zones[i];
+        }
+    }
+    return NULL;
+}
+
+// 内核不链接 libgcc，不能使用 __builtin_popcount
+static inline int
+__pm_popcount(uint32_t x)
+{
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    x = (x + (x >> 4)) & 0x0f0f0f0f;
+    return (x * 0x01010101) >> 24;
+}
+
+// 写入位图中的第 group 个字，并更新其所属区域的空闲页计数
+static void
+__pm_set_word(uint32_t group, uint32_t value)
+{
+    int before = __pm_popcount(__pm_word_free_mask(group));
+    pm_bitmap[group] = value;
+    int after = __pm_popcount(__pm_word_free_mask(group));
+
+    struct pm_zone* zone = __pm_zone_of(group * PM_BMP_WORD_BITS);
+    if (zone) {
+        zone->free_count += after - before;
+    }
+    pm_nodes[pm_chunk_node[group / PM_BMP_WORD_BITS]].free_count += after - before;
+}
+
+// 位图只覆盖到 max_pg 为止，之外的页（例如 APIC 等 MMIO）无需也无法标注
+static void
+__pm_mark_page(uintptr_t ppn, int occupied)
+{
+    if (ppn >= max_pg) {
+        return;
+    }
+
+    MARK_PG_AUX_VAR(ppn)
+    if (occupied) {
+        __pm_set_word(group, pm_bitmap[group] | msk);  // 标记为 已占用
+    } else {
+        __pm_set_word(group, pm_bitmap[group] & ~msk); // 标记为 空闲
+    }
+    __pm_index_update(ppn, 1);
+}
+
+static void
+__pm_mark_chunk(uintptr_t start_ppn, size_t page_count, int occupied)
+{
+    if (start_ppn >= max_pg) {
+        return;
+    }
+    if (page_count > max_pg - start_ppn) {
+        page_count = max_pg - start_ppn;
+    }
+
+    uintptr_t ppn = start_ppn;
+    size_t remain = page_count;
+
+    // 首尾两个字可能只有部分位需要修改，中间的字则整字写入
+    while (remain) {
+        uint32_t offset = ppn % PM_BMP_WORD_BITS;
+        uint32_t n = PM_BMP_WORD_BITS - offset;
+        if (n > remain) {
+            n = remain;
+        }
+        uint32_t group = ppn / PM_BMP_WORD_BITS;
+        if (occupied) {
+            __pm_set_word(group, pm_bitmap[group] | PM_RUN_MASK(offset, n));
+        } else {
+            __pm_set_word(group, pm_bitmap[group] & ~PM_RUN_MASK(offset, n));
+        }
+        ppn += n;
+        remain -= n;
+    }
+
+    __pm_index_update(start_ppn, page_count);
+}
 
 //标记 页 为 空闲
 void
 pmm_mark_page_free(uintptr_t ppn)
 {
-    MARK_PG_AUX_VAR(ppn)
-    pm_bitmap[group] = pm_bitmap[group] & ~msk; // 标记为 空闲
+    reg32 eflags;
+    PM_LOCK(eflags)
+    __pm_mark_page(ppn, 0);
+    PM_UNLOCK(eflags)
+}
+
+// 取 [start, end) 中的第一个空闲页并标注为 [已占用]，没有时返回 0
+static uintptr_t
+__pm_take_page(uintptr_t start, uintptr_t end)
+{
+    for (uintptr_t p = start; p < end;) {
+        uint32_t word = pm_bitmap[p / PM_BMP_WORD_BITS];
+        if (word == ~0U) {
+            p = ROUNDUP(p + 1, PM_BMP_WORD_BITS);
+            continue;
+        }
+        if (p && !(word & (1U << (p % PM_BMP_WORD_BITS)))) {
+            __pm_mark_page(p, 1);
+            return p;
+        }
+        p++;
+    }
+    return 0;
+}
+
+// 从 [from, end) 中等待上线的内存里取走地址最低的一页：它不再等待上线，在位图中保持 [已占用]。
+// 没有时返回 0
+static uintptr_t
+__pm_take_deferred(uintptr_t from, uintptr_t end)
+{
+    uint32_t k = pm_deferred_count;
+    uintptr_t ppn = end;
+    for (uint32_t i = 0; i < pm_deferred_count; i++) {
+        uintptr_t lo = pm_deferred[i].start > from ? pm_deferred[i].start : from;
+        if (lo < pm_deferred[i].end && lo < ppn) {
+            ppn = lo;
+            k = i;
+        }
+    }
+    if (k == pm_deferred_count) {
+        return 0;
+    }
+
+    // 该记录中 ppn 之前的部分都已上线，不再需要
+    pm_deferred[k].start = ppn + 1;
+    return ppn;
+}
+
+// 为 [pm_pages_end, end) 的描述符映射内存，要求持有 PM 锁。页表已由 pmm_init_pages 预先分配，
+//  映射时不会再向 PMM 申请页。
+// 所需的页优先取自 [from, end) 中等待上线的内存（取走后即不再上线，之后随所在的范围一起标为
+//  预留页），不够时取已上线的空闲页，mark 为真时在这里就将其标为预留页。
+// 返回 end 之前的描述符是否都已可用
+static int
+__pm_pages_grow(uintptr_t from, uintptr_t end, int mark)
+{
+    if (end <= pm_pages_end) {
+        return 1;
+    }
+
+    uintptr_t va = ROUNDUP((uintptr_t)&pm_pages[pm_pages_end], PG_SIZE);
+    uintptr_t va_end = ROUNDUP((uintptr_t)&pm_pages[end], PG_SIZE);
+    for (; va < va_end; va += PG_SIZE) {
+        int online = 0;
+        uintptr_t ppn = __pm_take_deferred(from, end);
+        if (!ppn) {
+            ppn = __pm_take_page(0, pm_online_end);
+            online = 1;
+        }
+        if (!ppn) {
+            break;
+        }
+
+        // 页表已经存在，映射不应失败。万一失败，取自等待上线的内存的页只能放弃
+        if (!vmm_map_range((void*)va, (paddr_t)ppn << PG_SIZE_BITS, PG_SIZE, PG_PREM_RW)) {
+            if (online) {
+                __pm_mark_page(ppn, 0);
+            }
+            break;
+        }
+
+        // 全零即 PP_FREE
+        memset((void*)va, 0, PG_SIZE);
+        if (online && mark) {
+            pm_pages[ppn] = (struct pm_page){ .ref_count = 1, .type = PP_RESERVED };
+            pm_reserved_count++;
+        }
+    }
+
+    // 同一页中 end 之后的描述符也已可用
+    uintptr_t described = (va - (uintptr_t)pm_pages) / sizeof(struct pm_page);
+    pm_pages_end = described < max_pg ? described : max_pg;
+    return pm_pages_end >= end;
+}
+
+// 上线 [pm_online_end, end) 中所有延迟的可用内存。
+// 描述符数组建立之后，只上线描述符已经可用的部分
+static void
+__pm_online_upto(uintptr_t end)
+{
+    uintptr_t start = pm_online_end;
+    if (end > max_pg) {
+        end = max_pg;
+    }
+    if (end <= start) {
+        return;
+    }
+
+    // 先为这些页的描述符映射内存，所需的页可能取自这次上线的内存本身
+    if (pm_pages && !__pm_pages_grow(start, end, 1)) {
+        end = pm_pages_end > start ? pm_pages_end : start;
+        if (end == start) {
+            return;
+        }
+    }
+
+    for (uint32_t i = 0; i < pm_deferred_count; i++) {
+        uintptr_t lo = pm_deferred[i].start > start ? pm_deferred[i].start : start;
+        uintptr_t hi = pm_deferred[i].end < end ? pm_deferred[i].end : end;
+        if (lo < hi) {
+            __pm_mark_chunk(lo, hi - lo, 0);
+        }
+    }
+
+    // 初始化其中已占用的页（包括用作描述符的页）的描述符
+    if (pm_pages) {
+        for (uintptr_t i = start; i < end; i++) {
+            if (pm_bitmap[i / PM_BMP_WORD_BITS] & (1U << (i % PM_BMP_WORD_BITS))) {
+                pm_pages[i] = (struct pm_page){ .ref_count = 1, .type = PP_RESERVED };
+                pm_reserved_count++;
+            }
+        }
+    }
+
+    pm_online_end = end;
+}
+
+// 是否还有尚未上线的内存
+static int
+__pm_has_deferred()
+{
+    for (uint32_t i = 0; i < pm_deferred_count; i++) {
+        if (pm_deferred[i].end > pm_online_end) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 再上线一块内存，返回是否确有内存上线
+static int
+__pm_online_more()
+{
+    if (!__pm_has_deferred()) {
+        return 0;
+    }
+    uintptr_t end = pm_online_end;
+    __pm_online_upto(pm_online_end + PM_ONLINE_CHUNK);
+    return pm_online_end > end;
+}
+
+// 将要标注为 [已占用] 的页如果还在等待上线，先将其上线，以免之后上线时被错误地释放
+static void
+__pm_online_overlap(uintptr_t start_ppn, size_t page_count)
+{
+    uintptr_t end = start_ppn + page_count;
+    for (uint32_t i = 0; i < pm_deferred_count; i++) {
+        if (pm_deferred[i].start < end && pm_deferred[i].end > start_ppn &&
+            pm_deferred[i].end > pm_online_end && end > pm_online_end) {
+            __pm_online_upto(ROUNDUP(end, PM_ONLINE_CHUNK));
+            return;
+        }
+    }
 }
 
 //标记 页 为 已占用
 void
 pmm_mark_page_occupied(uintptr_t ppn)
 {
-    MARK_PG_AUX_VAR(ppn)
-    pm_bitmap[group] = pm_bitmap[group] | msk;  // 标记为 已占用
+    reg32 eflags;
+    PM_LOCK(eflags)
+    __pm_online_overlap(ppn, 1);
+    __pm_mark_page(ppn, 1);
+    PM_UNLOCK(eflags)
 }
 
 //标记 块(多个页) 为 空闲
@@ -58,106 +552,1620 @@ pmm_mark_page_occupied(uintptr_t ppn)
 void
 pmm_mark_chunk_free(uintptr_t start_ppn, size_t page_count)
 {
-    MARK_CHUNK_AUX_VAR(start_ppn, page_count)
+    reg32 eflags;
+    PM_LOCK(eflags)
+    __pm_mark_chunk(start_ppn, page_count, 0);
+    PM_UNLOCK(eflags)
+}
+
+//标记 块(多个页) 为 已占用
+void
+pmm_mark_chunk_occupied(uintptr_t start_ppn, size_t page_count)
+{
+    reg32 eflags;
+    PM_LOCK(eflags)
+    __pm_online_overlap(start_ppn, page_count);
+    __pm_mark_chunk(start_ppn, page_count, 1);
+    PM_UNLOCK(eflags)
+}
 
-    // nasty bit level hacks but it reduce # of iterations.
+void
+pmm_defer_chunk_free(uintptr_t start_ppn, size_t page_count)
+{
+    uintptr_t end = start_ppn + page_count;
+    if (end > max_pg) {
+        end = max_pg;
+    }
 
-    pm_bitmap[group] &= ~(((1U << leading_shifts) - 1) << (8 - offset - leading_shifts));
+    reg32 eflags;
+    PM_LOCK(eflags)
 
-    group++;
+    // 已上线范围内的部分立即释放
+    uintptr_t split = end < pm_online_end ? end : pm_online_end;
+    if (start_ppn < split) {
+        __pm_mark_chunk(start_ppn, split - start_ppn, 0);
+        start_ppn = split;
+    }
 
-    // prevent unsigned overflow
-    for (uint32_t i = 0; group_count !=0 && i < group_count - 1; i++, group++) {
-        pm_bitmap[group] = 0;
+    if (start_ppn < end) {
+        if (pm_deferred_count < PM_DEFERRED_MAX) {
+            pm_deferred[pm_deferred_count].start = start_ppn;
+            pm_deferred[pm_deferred_count].end = end;
+            pm_deferred_count++;
+        } else {
+            // 记录不下了，只能立即释放
+            __pm_mark_chunk(start_ppn, end - start_ppn, 0);
+        }
     }
 
-    pm_bitmap[group] &=
-      ~(((1U << (page_count > 8 ? remainder : 0)) - 1) << (8 - remainder));
+    PM_UNLOCK(eflags)
 }
 
-//标记 块(多个页) 为 已占用
+int
+pmm_online_deferred()
+{
+    reg32 eflags;
+    PM_LOCK(eflags)
+    __pm_online_more();
+    int more = __pm_has_deferred();
+    PM_UNLOCK(eflags)
+
+    return more;
+}
+
+// 我们跳过位于0x0的页。我们不希望空指针是指向一个有效的内存空间。
+#define LOOKUP_START 1
+
 void
-pmm_mark_chunk_occupied(uint32_t start_ppn, size_t page_count)
+pmm_init(uintptr_t max_pfn)
 {
-    MARK_CHUNK_AUX_VAR(start_ppn, page_count)
+    max_pg = max_pfn < PM_MAX_PAGES ? max_pfn : PM_MAX_PAGES;
+
+    // 按 max_pg 裁剪各个区域，不存在的区域为空区间
+    uintptr_t zone_ends[PM_ZONE_COUNT] = {
+        [ZONE_DMA] = PM_ZONE_DMA_END,
+        [ZONE_NORMAL] = PM_ZONE_NORMAL_END,
+#ifdef CONFIG_PAE
+        [ZONE_HIGH] = PM_ZONE_HIGH_END,
+        [ZONE_PAE] = max_pg,
+#else
+        [ZONE_HIGH] = max_pg,
+#endif
+    };
+    uintptr_t start = 0;
+    for (int i = 0; i < PM_ZONE_COUNT; i++) {
+        uintptr_t end = zone_ends[i] < max_pg ? zone_ends[i] : max_pg;
+        pm_zones[i].start_pg = start;
+        pm_zones[i].end_pg = end > start ? end : start;
+        pm_zones[i].lookup_ptr = start ? start : LOOKUP_START;
+        pm_zones[i].free_count = 0;
+        pm_zones[i].watermark = 0;
+        start = pm_zones[i].end_pg;
+    }
+
+    // 在读取 SRAT 之前，只有一个覆盖全部内存的节点
+    pm_node_count = 1;
+    pm_node_assigned = 0;
+    pm_nodes[0] = (struct pm_node){ 0 };
+    pm_node_windows[0].count = 1;
+    pm_node_windows[0].win[0] = (struct pm_window){ 0, max_pg, 0 };
 
-    pm_bitmap[group] |= (((1U << leading_shifts) - 1) << (8 - offset - leading_shifts));
+    pm_deferred_count = 0;
+    pm_online_end = PM_ONLINE_EARLY_END < max_pg ? PM_ONLINE_EARLY_END : max_pg;
+
+    // 位图与伙伴树按实际的内存大小分配，而不是总按 4GiB 预留
+    size_t words = (max_pg + PM_BMP_WORD_BITS - 1) / PM_BMP_WORD_BITS;
+    if (words > PM_BMP_WORDS) {
+        words = PM_BMP_WORDS;
+    }
+    pm_buddy_leaves = PM_BUDDY_MIN_LEAVES;
+    pm_buddy_root_order = PM_BUDDY_LEAF_ORDER + 5;
+    while (pm_buddy_leaves < words) {
+        pm_buddy_leaves <<= 1;
+        pm_buddy_root_order++;
+    }
 
-    group++;
+    // 叶子也会读取位图，所以位图的长度与叶子数相同
+    pm_bitmap = memblock_alloc(pm_buddy_leaves * sizeof(uint32_t), sizeof(uint32_t));
+    pm_buddy_tree = memblock_alloc(pm_buddy_leaves * 2, sizeof(uint32_t));
 
-    // prevent unsigned overflow
-    for (uint32_t i = 0; group_count !=0 && i < group_count - 1; i++, group++) {
-        pm_bitmap[group] = 0xFFU;
+    // 此时还没有任何输出手段，没有元数据也就无从管理内存，只能停在这里
+    if (!pm_bitmap || !pm_buddy_tree) {
+        spin();
     }
 
-    pm_bitmap[group] |=
-      (((1U << (page_count > 8 ? remainder : 0)) - 1) << (8 - remainder));
+    // 标记所有物理页为 [已占用]（之后的页被 __pm_word_free_mask 屏蔽）
+    for (size_t i = 0; i < pm_buddy_leaves; i++) {
+        pm_bitmap[i] = ~0U;
+    }
 }
 
-// 我们跳过位于0x0的页。我们不希望空指针是指向一个有效的内存空间。
-#define LOOKUP_START 1
+// 借助摘要位图，寻找第 group 个字之后第一个含有空闲页的字，没有则返回 -1
+static int32_t
+__pm_next_free_group(uint32_t group)
+{
+    uint32_t g = group + 1;
+    uint32_t w = g / PM_BMP_WORD_BITS;
+    if (w >= PM_SUMMARY_L1_WORDS) {
+        return -1;
+    }
 
-//页 指针 指向
-size_t pg_lookup_ptr;
+    // 先看同一个 l1 字中是否还有
+    uint32_t bits = pm_summary_l1[w] & (~0U << (g % PM_BMP_WORD_BITS));
+    if (!bits) {
+        // 再借助 l2 找到之后第一个非空的 l1 字，最多读取 PM_SUMMARY_L2_WORDS 个字
+        w++;
+        uint32_t l2 = w / PM_BMP_WORD_BITS;
+        if (l2 >= PM_SUMMARY_L2_WORDS) {
+            return -1;
+        }
 
-void
-pmm_init(uintptr_t mem_upper_lim)
+        uint32_t l2_bits = pm_summary_l2[l2] & (~0U << (w % PM_BMP_WORD_BITS));
+        while (!l2_bits) {
+            if (++l2 >= PM_SUMMARY_L2_WORDS) {
+                return -1;
+            }
+            l2_bits = pm_summary_l2[l2];
+        }
+
+        w = l2 * PM_BMP_WORD_BITS + __builtin_ctz(l2_bits);
+        bits = pm_summary_l1[w];
+    }
+
+    return w * PM_BMP_WORD_BITS + __builtin_ctz(bits);
+}
+
+// 在 [from, to) 中寻找第一个空闲页，没有则返回 0
+static uintptr_t
+__pm_lookup_free(uintptr_t from, uintptr_t to)
+{
+    if (from >= to) {
+        return 0;
+    }
+
+    uint32_t group = from / PM_BMP_WORD_BITS;
+
+    // 大多数情况下 next-fit 指针所在的字就有空闲页
+    uint32_t chunk = __pm_word_free_mask(group) & (~0U << (from % PM_BMP_WORD_BITS));
+
+    if (!chunk) {
+        int32_t next = __pm_next_free_group(group);
+        if (next < 0) {
+            return 0;
+        }
+        group = next;
+        chunk = __pm_word_free_mask(group);
+    }
+
+    uintptr_t ppn = group * PM_BMP_WORD_BITS + __builtin_ctz(chunk);
+    return ppn < to ? ppn : 0;
+}
+
+// 位图中第 group 个字里颜色为 color 的页
+static uint32_t
+__pm_color_mask(uint32_t group, uint32_t color)
+{
+    // 颜色数不超过 32 时每个字都含有所有颜色，各颜色的位每隔 pm_colors 位重复一次
+    if (pm_colors <= PM_BMP_WORD_BITS) {
+        uint32_t msk = 0;
+        for (uint32_t i = color; i < PM_BMP_WORD_BITS; i += pm_colors) {
+            msk |= 1U << i;
+        }
+        return msk;
+    }
+
+    uint32_t offset = (color - group * PM_BMP_WORD_BITS) & (pm_colors - 1);
+    return offset < PM_BMP_WORD_BITS ? 1U << offset : 0;
+}
+
+// 在 [from, to) 中寻找第一个颜色为 color 的空闲页，没有则返回 0
+static uintptr_t
+__pm_lookup_color(uintptr_t from, uintptr_t to, uint32_t color)
+{
+    if (from >= to) {
+        return 0;
+    }
+
+    uint32_t group = from / PM_BMP_WORD_BITS;
+    uint32_t chunk = __pm_word_free_mask(group) & (~0U << (from % PM_BMP_WORD_BITS)) &
+                     __pm_color_mask(group, color);
+
+    // 有空闲页的字未必有这种颜色的空闲页，需要继续找下去
+    while (!chunk) {
+        int32_t next = __pm_next_free_group(group);
+        if (next < 0 || (uintptr_t)next * PM_BMP_WORD_BITS >= to) {
+            return 0;
+        }
+        group = next;
+        chunk = __pm_word_free_mask(group) & __pm_color_mask(group, color);
+    }
+
+    uintptr_t ppn = group * PM_BMP_WORD_BITS + __builtin_ctz(chunk);
+    return ppn < to ? ppn : 0;
+}
+
+// 求 zone 与窗口的交集 [*lo, *hi)，以及其中 next-fit 的起点，交集为空时返回 0
+static int
+__pm_clip(struct pm_zone* zone,
+          struct pm_window* win,
+          uintptr_t* lo,
+          uintptr_t* hi,
+          uintptr_t* ptr)
 {
-    max_pg = (PG_ALIGN(mem_upper_lim) >> 12);//对齐并将 字节 除以 2 ^ 12得到最大物理页编号
+    *lo = zone->start_pg > win->start ? zone->start_pg : win->start;
+    *lo = *lo ? *lo : LOOKUP_START;
+    *hi = zone->end_pg < win->end ? zone->end_pg : win->end;
+    *ptr = zone->lookup_ptr >= *lo && zone->lookup_ptr < *hi ? zone->lookup_ptr : *lo;
+    return *lo < *hi;
+}
 
-    pg_lookup_ptr = LOOKUP_START;
+// 当前处理器所在节点的窗口表
+#define PM_LOCAL_WINDOWS()      (&pm_node_windows[pm_cpu_node[cpu_id()]])
 
-    // 标记所有物理页为 [已占用]
-    for (size_t i = 0; i < PM_BMP_MAX_SIZE; i++) {
-        pm_bitmap[i] = 0xFFU;//0xFF = 1111 1111
+// 记录从 node 中分配了 pages 个页
+static inline void
+__pm_node_account(uint32_t node, size_t pages)
+{
+    pm_nodes[node].alloc_count += pages;
+    if (node != pm_cpu_node[cpu_id()]) {
+        pm_nodes[node].remote_count += pages;
     }
 }
 
-void*
-pmm_alloc_page()
+// 从位图中分配一个位于 zone 与窗口交集中的页（颜色为 color，PM_COLOR_ANY 即任意），
+//  返回物理页号，没有则返回 0
+static uintptr_t
+__pm_alloc_one(struct pm_zone* zone, struct pm_window* win, uint32_t color)
 {
+    uintptr_t start, end, ptr;
+    if (!__pm_clip(zone, win, &start, &end, &ptr)) {
+        return 0;
+    }
+
     // Next fit approach. Maximize the throughput!
-    uintptr_t good_page_found = (uintptr_t)NULL;
-    size_t old_pg_ptr = pg_lookup_ptr;
-    size_t upper_lim = max_pg;
-    uint8_t chunk = 0;
-    while (!good_page_found && pg_lookup_ptr < upper_lim) {
-        chunk = pm_bitmap[pg_lookup_ptr >> 3];
-
-        // skip the fully occupied chunk, reduce # of iterations
-        if (chunk != 0xFFU) {
-            for (size_t i = pg_lookup_ptr % 8; i < 8; i++, pg_lookup_ptr++) {
-                if (!(chunk & (0x80U >> i))) {
-                    pmm_mark_page_occupied(pg_lookup_ptr);
-                    good_page_found = pg_lookup_ptr << 12;
-                    break;
+    uintptr_t ppn = color == PM_COLOR_ANY ? __pm_lookup_free(ptr, end)
+                                          : __pm_lookup_color(ptr, end, color);
+
+    // We've searched the interval [lookup_ptr, end) but failed
+    //   may be chances in [start, lookup_ptr) ?
+    // Let's find out!
+    if (!ppn) {
+        ppn = color == PM_COLOR_ANY ? __pm_lookup_free(start, ptr)
+                                    : __pm_lookup_color(start, ptr, color);
+    }
+
+    if (ppn) {
+        __pm_mark_page(ppn, 1);
+        zone->lookup_ptr = ppn + 1;
+    }
+
+    return ppn;
+}
+
+// 按窗口由近及远，在每个窗口中从 zone 开始依次向更低的区域回落（HIGH -> NORMAL -> DMA），
+//  直到分配成功。回落到其他区域时，不得使该区域的空闲页低于其水位
+static uintptr_t
+__pm_alloc_fallback(int zone, uint32_t color)
+{
+    uint64_t begin = cpu_rdtsc();
+    pm_scan_count++;
+    do {
+        for (uint32_t k = 0; k < PM_LOCAL_WINDOWS()->count; k++) {
+            struct pm_window* win = &PM_LOCAL_WINDOWS()->win[k];
+            for (int i = zone; i >= 0; i--) {
+                struct pm_zone* z = &pm_zones[i];
+                if (i != zone && z->free_count <= z->watermark) {
+                    continue;
+                }
+
+                uintptr_t ppn = __pm_alloc_one(z, win, color);
+                if (ppn) {
+                    __pm_node_account(win->node, 1);
+                    pm_scan_cycles += cpu_rdtsc() - begin;
+                    return ppn;
                 }
             }
-        } else {
-            pg_lookup_ptr += 8;
+        }
+    } while (__pm_online_more());   // 都没有了？先上线一块再试试
+    pm_scan_cycles += cpu_rdtsc() - begin;
+    return 0;
+}
+
+// 把缓存底部的 n 个页归还给位图，要求中断已关闭
+static void
+__pm_mag_drain(struct pm_magazine* mag, uint32_t n)
+{
+    spinlock_acquire(&pm_lock);
+    for (uint32_t i = 0; i < n; i++) {
+        __pm_mark_page(mag->frames[i], 0);
+    }
+    spinlock_release(&pm_lock);
 
-            // We've searched the interval [old_pg_ptr, max_pg) but failed
-            //   may be chances in [1, old_pg_ptr) ?
-            // Let's find out!
-            if (pg_lookup_ptr >= upper_lim && old_pg_ptr != LOOKUP_START) {
-                upper_lim = old_pg_ptr;
-                pg_lookup_ptr = LOOKUP_START;
-                old_pg_ptr = LOOKUP_START;
+    for (uint32_t i = n; i < mag->count; i++) {
+        mag->frames[i - n] = mag->frames[i];
+    }
+    mag->count -= n;
+}
+
+void*
+pmm_alloc_page()
+{
+    reg32 eflags = cpu_disable_interrupt_save();
+    struct pm_magazine* mag = &pm_magazines[cpu_id()];
+
+    if (!mag->count) {
+        spinlock_acquire(&pm_lock);
+        while (mag->count < PM_MAG_BATCH) {
+            uintptr_t ppn = __pm_alloc_fallback(ZONE_HIGH, PM_COLOR_ANY);
+            if (!ppn) {
+                break;
             }
+            mag->frames[mag->count++] = ppn;
         }
+        spinlock_release(&pm_lock);
+    }
+
+    uintptr_t ppn = mag->count ? mag->frames[--mag->count] : 0;
+
+    struct pm_page* pp = PM_PAGE(ppn);
+    if (ppn && pp) {
+        *pp = (struct pm_page){ .ref_count = 1, .type = PP_KERNEL };
     }
-    return (void*)good_page_found;
+    PM_COUNT(alloc_pages, ppn != 0);
+
+    cpu_restore_interrupt(eflags);
+
+    return (void*)(ppn << PG_SIZE_BITS);
 }
 
-int
-pmm_free_page(void* page)
+void*
+pmm_alloc_page_zone(int zone)
 {
-    // TODO: Add kernel reserved memory page check
-    uint32_t pg = (uintptr_t)page >> 12;
-    if (pg && pg < max_pg)
-    {
-        pmm_mark_page_free(pg);
-        return 1;
+    if (zone < 0 || zone > ZONE_HIGH) {
+        return NULL;
     }
+
+    // 指定了区域的分配不经过页缓存，直接从该区域（或更低的区域）中分配
+    reg32 eflags;
+    PM_LOCK(eflags)
+    uintptr_t ppn = __pm_alloc_fallback(zone, PM_COLOR_ANY);
+
+    struct pm_page* pp = PM_PAGE(ppn);
+    if (ppn && pp) {
+        *pp = (struct pm_page){ .ref_count = 1, .type = PP_KERNEL };
+    }
+    PM_COUNT(alloc_pages, ppn != 0);
+    PM_UNLOCK(eflags)
+
+    return (void*)(ppn << PG_SIZE_BITS);
+}
+
+void*
+pmm_alloc_page_color(uint32_t color)
+{
+    if (!pm_colors) {
+        return pmm_alloc_page();
+    }
+
+    // 页缓存中的页颜色各异，着色分配直接从位图中取
+    reg32 eflags;
+    PM_LOCK(eflags)
+    uintptr_t ppn = __pm_alloc_fallback(ZONE_HIGH, color & (pm_colors - 1));
+
+    struct pm_page* pp = PM_PAGE(ppn);
+    if (ppn && pp) {
+        *pp = (struct pm_page){ .ref_count = 1, .type = PP_KERNEL };
+    }
+    PM_COUNT(alloc_pages, ppn != 0);
+    PM_UNLOCK(eflags)
+
+    // 这种颜色的页用完了，退而求其次
+    if (!ppn) {
+        return pmm_alloc_page();
+    }
+    return (void*)(ppn << PG_SIZE_BITS);
+}
+
+void
+pmm_color_init(uint32_t colors)
+{
+    // 只使用 2 的幂，多余的颜色合并
+    uint32_t n = 1;
+    while (n << 1 <= colors && n << 1 <= PM_COLOR_MAX) {
+        n <<= 1;
+    }
+    pm_colors = n > 1 ? n : 0;
+}
+
+uint32_t
+pmm_colors()
+{
+    return pm_colors;
+}
+
+// 释放页的一个引用。返回 -1 表示该页不可释放，0 表示该页仍被引用，
+// 1 表示该页已无引用，应当归还给分配器
+static int
+__pm_page_put(uintptr_t pg)
+{
+    if (!pg || pg >= max_pg) {
+        return -1;
+    }
+
+    struct pm_page* pp = PM_PAGE(pg);
+    if (pp) {
+        // 系统预留页永远不会被释放；被共享的页只减少引用。
+        // 块的首页只释放它自己，块中其余的页就再也无法归还了，须经 pmm_free_pages 释放
+        if (pp->type == PP_RESERVED || !pp->ref_count || (pp->flags & PP_FL_BLOCK_HEAD)) {
+            return -1;
+        }
+        if (__sync_sub_and_fetch(&pp->ref_count, 1)) {
+            return 0;
+        }
+        pp->type = PP_FREE;
+        pp->flags = 0;
+    }
+    return 1;
+}
+
+int
+pmm_free_page(void* page)
+{
+    return pmm_free_frame((uintptr_t)page >> PG_SIZE_BITS);
+}
+
+int
+pmm_free_frame(uintptr_t pg)
+{
+    // 误把块当作单个页释放时，按块释放
+    struct pm_page* pp = PM_PAGE(pg);
+    if (pp && (pp->flags & PP_FL_BLOCK_HEAD)) {
+        return pmm_free_pages((void*)(pg << PG_SIZE_BITS), pp->private);
+    }
+
+    int put = __pm_page_put(pg);
+    if (put <= 0) {
+        return put == 0;
+    }
+
+    reg32 eflags = cpu_disable_interrupt_save();
+#ifdef CONFIG_PAE
+    // 页缓存会被 pmm_alloc_page 取用，4GiB 以上的页直接归还给位图
+    if (pg >= PM_ZONE_HIGH_END) {
+        spinlock_acquire(&pm_lock);
+        __pm_mark_page(pg, 0);
+        spinlock_release(&pm_lock);
+        PM_COUNT(free_pages, 1);
+        cpu_restore_interrupt(eflags);
+        return 1;
+    }
+#endif
+    struct pm_magazine* mag = &pm_magazines[cpu_id()];
+
+    if (mag->count == PM_MAG_SIZE) {
+        __pm_mag_drain(mag, PM_MAG_BATCH);
+    }
+    mag->frames[mag->count++] = pg;
+    PM_COUNT(free_pages, 1);
+
+    cpu_restore_interrupt(eflags);
+    return 1;
+}
+
+// 在 zone 与窗口的交集中以一次 next-fit 扫描分配至多 n 个页，将物理页号放入 frames。
+// 同一个字中的空闲页被一并取走，位图与索引每个字只更新一次。返回实际分配的页数
+static size_t
+__pm_alloc_bulk(struct pm_zone* zone,
+                struct pm_window* win,
+                size_t n,
+                uintptr_t frames[])
+{
+    uintptr_t start, end, ptr;
+    if (!__pm_clip(zone, win, &start, &end, &ptr)) {
+        return 0;
+    }
+
+    uintptr_t from = ptr, to = end;
+    size_t got = 0;
+
+    // 先扫描 [lookup_ptr, end)，不够再扫描 [start, lookup_ptr)
+    for (int pass = 0; pass < 2 && got < n; pass++) {
+        uintptr_t ppn;
+        while (got < n && (ppn = __pm_lookup_free(from, to))) {
+            uint32_t group = ppn / PM_BMP_WORD_BITS;
+            uint32_t chunk =
+              __pm_word_free_mask(group) & (~0U << (ppn % PM_BMP_WORD_BITS));
+            uint32_t taken = 0;
+
+            while (chunk && got < n) {
+                ppn = group * PM_BMP_WORD_BITS + __builtin_ctz(chunk);
+                if (ppn >= to) {
+                    break;
+                }
+                frames[got++] = ppn;
+                zone->lookup_ptr = ppn + 1;
+                taken |= chunk & -chunk;
+                chunk &= chunk - 1;
+            }
+
+            if (taken) {
+                __pm_set_word(group, pm_bitmap[group] | taken);
+                __pm_index_update(group * PM_BMP_WORD_BITS, PM_BMP_WORD_BITS);
+            }
+
+            from = (group + 1) * PM_BMP_WORD_BITS;
+        }
+        from = start;
+        to = ptr;
+    }
+
+    return got;
+}
+
+// 批量分配的主体：从 zone 开始向更低的区域回落，分配至多 n 个页，将物理页号放入 frames
+static size_t
+__pm_alloc_frames(int zone, size_t n, uintptr_t frames[])
+{
+    size_t got = 0;
+    reg32 eflags = cpu_disable_interrupt_save();
+
+    // 页缓存中的页最热，优先使用。PAE 下从 ZONE_PAE 开始分配时不取，把低端的页留给指针接口
+    struct pm_magazine* mag = &pm_magazines[cpu_id()];
+    while (zone == ZONE_HIGH && got < n && mag->count) {
+        frames[got++] = mag->frames[--mag->count];
+    }
+
+    if (got < n) {
+        spinlock_acquire(&pm_lock);
+        uint64_t begin = cpu_rdtsc();
+        pm_scan_count++;
+        do {
+            for (uint32_t k = 0; k < PM_LOCAL_WINDOWS()->count && got < n; k++) {
+                struct pm_window* win = &PM_LOCAL_WINDOWS()->win[k];
+                for (int i = zone; i >= 0 && got < n; i--) {
+                    struct pm_zone* z = &pm_zones[i];
+                    size_t want = n - got;
+                    if (i != zone) {
+                        // 回落时同样不得低于水位
+                        if (z->free_count <= z->watermark) {
+                            continue;
+                        }
+                        if (want > z->free_count - z->watermark) {
+                            want = z->free_count - z->watermark;
+                        }
+                    }
+                    size_t taken = __pm_alloc_bulk(z, win, want, &frames[got]);
+                    __pm_node_account(win->node, taken);
+                    got += taken;
+                }
+            }
+        } while (got < n && __pm_online_more());   // 上线了新的内存，从头再来
+        pm_scan_cycles += cpu_rdtsc() - begin;
+        spinlock_release(&pm_lock);
+    }
+
+    for (size_t i = 0; i < got; i++) {
+        struct pm_page* pp = PM_PAGE(frames[i]);
+        if (pp) {
+            *pp = (struct pm_page){ .ref_count = 1, .type = PP_KERNEL };
+        }
+    }
+    PM_COUNT(alloc_pages, got);
+
+    cpu_restore_interrupt(eflags);
+    return got;
+}
+
+size_t
+pmm_alloc_pages_bulk(size_t n, void* frames[])
+{
+    // 分批取得物理页号，再转换为地址
+    uintptr_t ppns[PM_MAG_BATCH];
+    size_t got = 0;
+    while (got < n) {
+        size_t want = n - got < PM_MAG_BATCH ? n - got : PM_MAG_BATCH;
+        size_t taken = __pm_alloc_frames(ZONE_HIGH, want, ppns);
+        for (size_t i = 0; i < taken; i++) {
+            frames[got++] = (void*)(ppns[i] << PG_SIZE_BITS);
+        }
+        if (taken < want) {
+            break;
+        }
+    }
+    return got;
+}
+
+size_t
+pmm_alloc_frames_bulk(size_t n, uintptr_t frames[])
+{
+    return __pm_alloc_frames(PM_ZONE_FRAME, n, frames);
+}
+
+uintptr_t
+pmm_alloc_frame()
+{
+    uintptr_t ppn = 0;
+    __pm_alloc_frames(PM_ZONE_FRAME, 1, &ppn);
+    return ppn;
+}
+
+size_t
+pmm_free_pages_bulk(size_t n, void* frames[])
+{
+    uintptr_t ppns[PM_MAG_BATCH];
+    size_t freed = 0;
+    for (size_t i = 0; i < n; i += PM_MAG_BATCH) {
+        size_t m = n - i < PM_MAG_BATCH ? n - i : PM_MAG_BATCH;
+        for (size_t j = 0; j < m; j++) {
+            ppns[j] = (uintptr_t)frames[i + j] >> PG_SIZE_BITS;
+        }
+        freed += pmm_free_frames_bulk(m, ppns);
+    }
+    return freed;
+}
+
+size_t
+pmm_free_frames_bulk(size_t n, uintptr_t frames[])
+{
+    size_t freed = 0;
+    uint32_t group = 0, msk = 0;
+
+    reg32 eflags;
+    PM_LOCK(eflags)
+    for (size_t i = 0; i < n; i++) {
+        uintptr_t pg = frames[i];
+        int put = __pm_page_put(pg);
+        if (put < 0) {
+            continue;
+        }
+        freed++;
+        if (!put) {
+            continue;
+        }
+
+        // 同一个字中的页一并归还，位图与索引每个字只更新一次
+        if (msk && pg / PM_BMP_WORD_BITS != group) {
+            __pm_set_word(group, pm_bitmap[group] & ~msk);
+            __pm_index_update(group * PM_BMP_WORD_BITS, PM_BMP_WORD_BITS);
+            msk = 0;
+        }
+        group = pg / PM_BMP_WORD_BITS;
+        msk |= 1U << (pg % PM_BMP_WORD_BITS);
+        PM_COUNT(free_pages, 1);
+    }
+    if (msk) {
+        __pm_set_word(group, pm_bitmap[group] & ~msk);
+        __pm_index_update(group * PM_BMP_WORD_BITS, PM_BMP_WORD_BITS);
+    }
+    PM_UNLOCK(eflags)
+
+    return freed;
+}
+
+// 计算叶子节点的值：其中最大的对齐空闲块的阶 + 1
+static uint8_t
+__pm_leaf_value(uint32_t leaf)
+{
+    uint32_t msk = __pm_word_free_mask(leaf);
+    uint8_t value = 0;
+    while (msk) {
+        value++;
+        if (value > PM_BUDDY_LEAF_ORDER) {
+            break;
+        }
+        msk = msk & (msk >> (1U << (value - 1))) & pm_buddy_pair_msk[value - 1];
+    }
+    return value;
+}
+
+// 在叶子中寻找一个 2^order 个页的对齐空闲块，返回其在叶子内的页偏移
+static uint32_t
+__pm_leaf_find(uint32_t leaf, uint32_t order)
+{
+    uint32_t msk = __pm_word_free_mask(leaf);
+    for (uint32_t i = 0; i < order; i++) {
+        msk = msk & (msk >> (1U << i)) & pm_buddy_pair_msk[i];
+    }
+
+    // 取最低位，即地址最低的空闲块
+    return __builtin_ctz(msk);
+}
+
+static void
+__pm_index_update(uintptr_t start_ppn, size_t page_count)
+{
+    if (!page_count || start_ppn >= (pm_buddy_leaves << PM_BUDDY_LEAF_ORDER)) {
+        return;
+    }
+
+    uint32_t lo = start_ppn >> PM_BUDDY_LEAF_ORDER;
+    uint32_t hi = (start_ppn + page_count - 1) >> PM_BUDDY_LEAF_ORDER;
+    if (hi >= pm_buddy_leaves) {
+        hi = pm_buddy_leaves - 1;
+    }
+
+    for (uint32_t g = lo; g <= hi; g++) {
+        uint32_t bit = 1U << (g % PM_BMP_WORD_BITS);
+        if (__pm_word_free_mask(g)) {
+            pm_summary_l1[g / PM_BMP_WORD_BITS] |= bit;
+        } else {
+            pm_summary_l1[g / PM_BMP_WORD_BITS] &= ~bit;
+        }
+    }
+
+    for (uint32_t w = lo / PM_BMP_WORD_BITS; w <= hi / PM_BMP_WORD_BITS; w++) {
+        uint32_t bit = 1U << (w % PM_BMP_WORD_BITS);
+        if (pm_summary_l1[w]) {
+            pm_summary_l2[w / PM_BMP_WORD_BITS] |= bit;
+        } else {
+            pm_summary_l2[w / PM_BMP_WORD_BITS] &= ~bit;
+        }
+    }
+
+    lo += pm_buddy_leaves;
+    hi += pm_buddy_leaves;
+
+    int changed = 0;
+    for (uint32_t i = lo; i <= hi; i++) {
+        uint8_t value = __pm_leaf_value(i - pm_buddy_leaves);
+        changed |= pm_buddy_tree[i] != value;
+        pm_buddy_tree[i] = value;
+    }
+
+    // 父节点的阶，两个伙伴都完全空闲时父节点的值即为 order + 1
+    // 某一层没有任何节点发生变化时，更高层也不会变化，可以提前结束
+    uint32_t order = PM_BUDDY_LEAF_ORDER + 1;
+    for (; changed && lo > 1; order++) {
+        lo >>= 1;
+        hi >>= 1;
+        changed = 0;
+        for (uint32_t i = lo; i <= hi; i++) {
+            uint8_t left = pm_buddy_tree[i << 1];
+            uint8_t right = pm_buddy_tree[(i << 1) + 1];
+            uint8_t value;
+            if (left == order && right == order) {
+                value = order + 1;
+            } else {
+                value = left > right ? left : right;
+            }
+            changed |= pm_buddy_tree[i] != value;
+            pm_buddy_tree[i] = value;
+        }
+    }
+}
+
+// 在以 node 为根的子树中，寻找落在 [lo, hi) 内、能容纳 2^order 个页的最左侧节点
+// 优先左侧，即低地址。没有则返回 0
+static uint32_t
+__pm_tree_find(uint32_t node,
+               uint32_t node_order,
+               uint32_t order,
+               uintptr_t lo,
+               uintptr_t hi)
+{
+    uint32_t depth = pm_buddy_root_order - node_order;
+    uintptr_t base = (uintptr_t)(node - (1U << depth)) << node_order;
+    if (pm_buddy_tree[node] < order + 1 || base >= hi ||
+        base + (1UL << node_order) <= lo) {
+        return 0;
+    }
+
+    // 区域之间的边界（16MiB、768MiB、4GiB）按 4MiB 对齐，不小于最大块；最后一个区域止于 max_pg，
+    //  其后的页从不空闲。因此与区域相交的空闲节点必然完全落在区域内
+    if (node_order == order || node >= pm_buddy_leaves) {
+        return node;
+    }
+
+    uint32_t found =
+      __pm_tree_find(node << 1, node_order - 1, order, lo, hi);
+    if (!found) {
+        found = __pm_tree_find((node << 1) + 1, node_order - 1, order, lo, hi);
+    }
+    return found;
+}
+
+// 从伙伴树中分配一个位于 zone 与窗口交集中的 2^order 个页的块，返回起始物理页号，没有则返回 0
+static uintptr_t
+__pm_alloc_block(struct pm_zone* zone, struct pm_window* win, uint32_t order)
+{
+    uintptr_t start, end, ptr;
+    if (!__pm_clip(zone, win, &start, &end, &ptr)) {
+        return 0;
+    }
+
+    uint32_t node = __pm_tree_find(1, pm_buddy_root_order, order, start, end);
+    if (!node) {
+        return 0;
+    }
+
+    uintptr_t ppn;
+    if (node >= pm_buddy_leaves) {
+        uint32_t leaf = node - pm_buddy_leaves;
+        ppn = (leaf << PM_BUDDY_LEAF_ORDER) + __pm_leaf_find(leaf, order);
+    } else {
+        uint32_t node_order = order;
+        uint32_t depth = pm_buddy_root_order - node_order;
+        ppn = (uintptr_t)(node - (1U << depth)) << node_order;
+    }
+
+    __pm_mark_chunk(ppn, 1U << order, 1);
+    return ppn;
+}
+
+// 与 __pm_alloc_fallback 相同的回落顺序与水位规则
+static uintptr_t
+__pm_alloc_block_fallback(int zone, uint32_t order)
+{
+    uint64_t begin = cpu_rdtsc();
+    pm_scan_count++;
+    do {
+        for (uint32_t k = 0; k < PM_LOCAL_WINDOWS()->count; k++) {
+            struct pm_window* win = &PM_LOCAL_WINDOWS()->win[k];
+            for (int i = zone; i >= 0; i--) {
+                struct pm_zone* z = &pm_zones[i];
+                if (i != zone && z->free_count < z->watermark + (1U << order)) {
+                    continue;
+                }
+
+                uintptr_t ppn = __pm_alloc_block(z, win, order);
+                if (ppn) {
+                    __pm_node_account(win->node, 1U << order);
+                    pm_scan_cycles += cpu_rdtsc() - begin;
+                    return ppn;
+                }
+            }
+        }
+    } while (__pm_online_more());
+    pm_scan_cycles += cpu_rdtsc() - begin;
     return 0;
 }
+
+// 块中的每个页都属于调用者，但只有首页记录引用计数与阶
+static void
+__pm_block_claim(uintptr_t ppn, uint32_t order)
+{
+    struct pm_page* head = ppn ? PM_PAGE(ppn) : NULL;
+    if (!head) {
+        return;
+    }
+    for (uint32_t i = 0; i < (1U << order); i++) {
+        struct pm_page* pp = PM_PAGE(ppn + i);
+        if (pp) {
+            *pp = (struct pm_page){ .type = PP_KERNEL };
+        }
+    }
+    head->ref_count = 1;
+    head->flags = PP_FL_BLOCK_HEAD;
+    head->private = order;
+}
+
+void*
+pmm_alloc_pages_zone(uint32_t order, int zone)
+{
+    if (order > PM_MAX_ORDER || zone < 0 || zone > ZONE_HIGH) {
+        return NULL;
+    }
+
+    reg32 eflags;
+    PM_LOCK(eflags)
+    uintptr_t ppn = __pm_alloc_block_fallback(zone, order);
+    spinlock_release(&pm_lock);
+
+    // 缓存中的页在位图中是 [已占用] 的，它们也许恰好能凑成一个块
+    struct pm_magazine* mag = &pm_magazines[cpu_id()];
+    if (!ppn && mag->count) {
+        __pm_mag_drain(mag, mag->count);
+
+        spinlock_acquire(&pm_lock);
+        ppn = __pm_alloc_block_fallback(zone, order);
+        spinlock_release(&pm_lock);
+    }
+
+    __pm_block_claim(ppn, order);
+    PM_COUNT(alloc_pages, ppn ? 1U << order : 0);
+
+    cpu_restore_interrupt(eflags);
+    return (void*)(ppn << PG_SIZE_BITS);
+}
+
+void*
+pmm_alloc_pages(uint32_t order)
+{
+    return pmm_alloc_pages_zone(order, ZONE_HIGH);
+}
+
+void*
+pmm_try_alloc_pages(uint32_t order)
+{
+    if (order > PM_MAX_ORDER) {
+        return NULL;
+    }
+
+    reg32 eflags;
+    PM_LOCK(eflags)
+    uintptr_t ppn = __pm_alloc_block_fallback(ZONE_HIGH, order);
+    __pm_block_claim(ppn, order);
+    PM_COUNT(alloc_pages, ppn ? 1U << order : 0);
+    PM_UNLOCK(eflags)
+
+    return (void*)(ppn << PG_SIZE_BITS);
+}
+
+int
+pmm_free_pages(void* addr, uint32_t order)
+{
+    uintptr_t pg = (uintptr_t)addr >> PG_SIZE_BITS;
+    if (order > PM_MAX_ORDER || (pg & ((1U << order) - 1))) {
+        return 0;
+    }
+
+    if (!pg || pg + (1U << order) > max_pg) {
+        return 0;
+    }
+
+    if (pm_pages) {
+        // 描述符可用的页才可能是分配出去的
+        if (pg + (1U << order) > pm_pages_end) {
+            return 0;
+        }
+        struct pm_page* head = PM_PAGE(pg);
+        if (head->type == PP_RESERVED || !head->ref_count) {
+            return 0;
+        }
+
+        // 阶与分配时不同：过大会释放不属于调用者的页，过小则块的其余部分再也无法归还
+        if ((head->flags & PP_FL_BLOCK_HEAD) && head->private != order) {
+            return 0;
+        }
+
+        // 已被拆分的块（见 pmm_split_pages）：每个页各自放弃一个引用
+        if (order && !(head->flags & PP_FL_BLOCK_HEAD)) {
+            int ok = 1;
+            for (uint32_t i = 0; i < (1U << order); i++) {
+                ok &= pmm_free_frame(pg + i);
+            }
+            return ok;
+        }
+
+        if (__sync_sub_and_fetch(&head->ref_count, 1)) {
+            return 1;
+        }
+        memset(head, 0, sizeof(struct pm_page) << order);
+    }
+
+    reg32 eflags;
+    PM_LOCK(eflags)
+    __pm_mark_chunk(pg, 1U << order, 0);
+    PM_COUNT(free_pages, 1U << order);
+    PM_UNLOCK(eflags)
+    return 1;
+}
+
+int
+pmm_split_pages(void* addr, uint32_t order)
+{
+    uintptr_t pg = (uintptr_t)addr >> PG_SIZE_BITS;
+    struct pm_page* head = PM_PAGE(pg);
+    if (!head || !head->ref_count || head->type == PP_RESERVED || pg + (1U << order) > pm_pages_end) {
+        return 0;
+    }
+    if (!(head->flags & PP_FL_BLOCK_HEAD)) {
+        return 1;
+    }
+    if (head->private != order) {
+        return 0;
+    }
+
+    // 块的每个引用者都引用了其中的每个页
+    for (uint32_t i = 1; i < (1U << order); i++) {
+        pm_pages[pg + i] = (struct pm_page){ .type = head->type, .ref_count = head->ref_count };
+    }
+    head->flags = 0;
+    head->private = 0;
+    return 1;
+}
+
+int
+pmm_ref_pages(void* addr, uint32_t order)
+{
+    uintptr_t pg = (uintptr_t)addr >> PG_SIZE_BITS;
+    struct pm_page* head = PM_PAGE(pg);
+    if (!order || !head || (head->flags & PP_FL_BLOCK_HEAD)) {
+        return pmm_ref_frame(pg);
+    }
+
+    for (uint32_t i = 0; i < (1U << order); i++) {
+        if (!pmm_ref_frame(pg + i)) {
+            while (i--) {
+                pmm_free_frame(pg + i);
+            }
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int
+pmm_init_pages()
+{
+    // 描述符数组只保留地址，之后随内存上线逐块映射，启动时间不随内存大小增长。
+    // 映射时持有 PM 锁，无法再为页表向 PMM 申请页，所以页表现在就全部分配
+    size_t sz = ROUNDUP(max_pg * sizeof(struct pm_page), PG_SIZE);
+    struct pm_page* pages = vmm_reserve_range(sz, PG_SIZE);
+    if (!pages) {
+        return 0;
+    }
+    if (!vmm_alloc_tables(pages, sz)) {
+        vmm_release_range(pages);
+        return 0;
+    }
+
+    // 已上线部分的描述符现在就分配（全零即 PP_FREE）
+    size_t early = ROUNDUP(pm_online_end * sizeof(struct pm_page), PG_SIZE);
+    if (early > sz) {
+        early = sz;
+    }
+    if (!vmm_alloc_zeroed_pages(pages, early, PG_PREM_RW)) {
+        vmm_release_range(pages);
+        return 0;
+    }
+
+    reg32 eflags = cpu_disable_interrupt_save();
+
+    // 页缓存中的页在位图中也是 [已占用]，先归还给位图，以免被当作预留页
+    struct pm_magazine* mag = &pm_magazines[cpu_id()];
+    __pm_mag_drain(mag, mag->count);
+
+    // 此前分配出去的页（内核栈、页表、堆，包括描述符本身）都不会被释放，
+    //  与内核映像、BIOS 等一起视为预留页
+    spinlock_acquire(&pm_lock);
+    pm_pages = pages;
+    pm_pages_end = early / sizeof(struct pm_page);
+    pm_pages_end = pm_pages_end < max_pg ? pm_pages_end : max_pg;
+
+    // 分配描述符期间可能又上线了内存，它们的描述符同样必须可用
+    if (!__pm_pages_grow(pm_online_end, pm_online_end, 0)) {
+        pm_pages = NULL;
+        spinlock_release(&pm_lock);
+        cpu_restore_interrupt(eflags);
+        return 0;
+    }
+    for (uintptr_t i = 0; i < pm_online_end; i++) {
+        if (pm_bitmap[i / PM_BMP_WORD_BITS] & (1U << (i % PM_BMP_WORD_BITS))) {
+            pages[i] = (struct pm_page){ .ref_count = 1, .type = PP_RESERVED };
+            pm_reserved_count++;
+        }
+    }
+    spinlock_release(&pm_lock);
+
+    cpu_restore_interrupt(eflags);
+    return 1;
+}
+
+struct pm_page*
+pmm_page(void* page)
+{
+    return PM_PAGE((uintptr_t)page >> PG_SIZE_BITS);
+}
+
+struct pm_page*
+pmm_frame(uintptr_t ppn)
+{
+    return PM_PAGE(ppn);
+}
+
+int
+pmm_ref_page(void* page)
+{
+    return pmm_ref_frame((uintptr_t)page >> PG_SIZE_BITS);
+}
+
+int
+pmm_ref_frame(uintptr_t ppn)
+{
+    struct pm_page* pp = PM_PAGE(ppn);
+    if (!pp || !pp->ref_count || pp->type == PP_RESERVED) {
+        return 0;
+    }
+
+    __sync_add_and_fetch(&pp->ref_count, 1);
+    return 1;
+}
+
+void
+pmm_init_zones()
+{
+    reg32 eflags;
+    PM_LOCK(eflags)
+    for (int i = 0; i < PM_ZONE_COUNT; i++) {
+        struct pm_zone* z = &pm_zones[i];
+        if (i != ZONE_DMA) {
+            z->watermark = 0;
+            continue;
+        }
+
+        // 尚未上线的内存也要计入，否则水位会随着上线而失去意义
+        size_t pages = z->free_count;
+        for (uint32_t j = 0; j < pm_deferred_count; j++) {
+            uintptr_t lo = pm_deferred[j].start;
+            uintptr_t hi = pm_deferred[j].end;
+            lo = lo > z->start_pg ? lo : z->start_pg;
+            lo = lo > pm_online_end ? lo : pm_online_end;
+            hi = hi < z->end_pg ? hi : z->end_pg;
+            pages += hi > lo ? hi - lo : 0;
+        }
+        z->watermark = pages >> PM_ZONE_WMARK_SHIFT;
+    }
+    PM_UNLOCK(eflags)
+}
+
+struct pm_zone*
+pmm_zone(int zone)
+{
+    if (zone < 0 || zone >= PM_ZONE_COUNT) {
+        return NULL;
+    }
+    return &pm_zones[zone];
+}
+
+int
+pmm_node_add_range(uint32_t proximity, uintptr_t start_pg, uintptr_t end_pg)
+{
+    reg32 eflags;
+    PM_LOCK(eflags)
+
+    // 第一个出现的邻近域接管节点 0
+    uint32_t node = 0;
+    if (!pm_node_assigned) {
+        pm_nodes[0].proximity = proximity;
+        pm_node_assigned = 1;
+    } else {
+        while (node < pm_node_count && pm_nodes[node].proximity != proximity) {
+            node++;
+        }
+        if (node == pm_node_count) {
+            if (pm_node_count == PM_NODE_MAX) {
+                PM_UNLOCK(eflags)
+                return -1;
+            }
+            pm_nodes[node] = (struct pm_node){ .proximity = proximity };
+            pm_node_count++;
+        }
+    }
+
+    // 起始页落在范围内的块都归属该节点，同时转移其空闲页计数
+    uintptr_t c = (start_pg + PM_NODE_CHUNK_PAGES - 1) / PM_NODE_CHUNK_PAGES;
+    for (; c < PM_NODE_CHUNKS && c * PM_NODE_CHUNK_PAGES < end_pg; c++) {
+        size_t free = 0;
+        for (uint32_t g = 0; g < PM_BMP_WORD_BITS; g++) {
+            free += __pm_popcount(__pm_word_free_mask(c * PM_BMP_WORD_BITS + g));
+        }
+        pm_nodes[pm_chunk_node[c]].free_count -= free;
+        pm_nodes[node].free_count += free;
+        pm_chunk_node[c] = node;
+    }
+
+    PM_UNLOCK(eflags)
+    return node;
+}
+
+// 节点 a 到节点 b 的距离
+static uint32_t
+__pm_node_distance(const uint8_t* distance,
+                   uint32_t locality_count,
+                   uint32_t a,
+                   uint32_t b)
+{
+    uint32_t pa = pm_nodes[a].proximity, pb = pm_nodes[b].proximity;
+    if (distance && pa < locality_count && pb < locality_count) {
+        return distance[pa * locality_count + pb];
+    }
+    return a == b ? 10 : 20;
+}
+
+void
+pmm_numa_init(const uint8_t* distance,
+              uint32_t locality_count,
+              uint32_t cpu_proximity)
+{
+    reg32 eflags;
+    PM_LOCK(eflags)
+
+    uint32_t chunks = (max_pg + PM_NODE_CHUNK_PAGES - 1) / PM_NODE_CHUNK_PAGES;
+    for (uint32_t n = 0; n < pm_node_count; n++) {
+        // 按距离由近及远排列所有节点（插入排序，自身距离最小，总在最前）
+        uint32_t order[PM_NODE_MAX];
+        for (uint32_t i = 0; i < pm_node_count; i++) {
+            uint32_t d = __pm_node_distance(distance, locality_count, n, i);
+            uint32_t j = i;
+            for (; j > 0; j--) {
+                uint32_t dj =
+                  __pm_node_distance(distance, locality_count, n, order[j - 1]);
+                if (dj < d || (dj == d && order[j - 1] == n)) {
+                    break;
+                }
+                order[j] = order[j - 1];
+            }
+            order[j] = i;
+        }
+
+        // 依次把每个节点中连续的块作为窗口
+        uint32_t count = 0;
+        struct pm_window* win = pm_node_windows[n].win;
+        for (uint32_t i = 0; i < pm_node_count; i++) {
+            for (uint32_t c = 0; c < chunks; c++) {
+                if (pm_chunk_node[c] != order[i]) {
+                    continue;
+                }
+                uintptr_t start = c * PM_NODE_CHUNK_PAGES;
+                if (count && win[count - 1].node == order[i] &&
+                    win[count - 1].end == start) {
+                    win[count - 1].end = start + PM_NODE_CHUNK_PAGES;
+                    continue;
+                }
+                // 窗口表满了，用一个覆盖全部内存的窗口兜底
+                if (count == PM_NODE_WINDOWS - 1) {
+                    win[count++] = (struct pm_window){ 0, max_pg, order[i] };
+                    goto done;
+                }
+                win[count++] =
+                  (struct pm_window){ start, start + PM_NODE_CHUNK_PAGES, order[i] };
+            }
+        }
+    done:
+        if (count && win[count - 1].end > max_pg) {
+            win[count - 1].end = max_pg;
+        }
+        pm_node_windows[n].count = count;
+    }
+
+    uint32_t node = 0;
+    while (node < pm_node_count && pm_nodes[node].proximity != cpu_proximity) {
+        node++;
+    }
+    pm_cpu_node[cpu_id()] = node < pm_node_count ? node : 0;
+
+    PM_UNLOCK(eflags)
+}
+
+struct pm_node*
+pmm_node(int node)
+{
+    if (node < 0 || (uint32_t)node >= pm_node_count) {
+        return NULL;
+    }
+    return &pm_nodes[node];
+}
+
+int
+pmm_node_count()
+{
+    return pm_node_count;
+}
+
+/*
+ * 预清零页池
+ *
+ * 页表、堆等需要全零页面的地方原本都在分配路径上就地 memset。
+ * 我们在空闲时（pmm_refill_zeroed_pool）预先把一批页清零放入池中，
+ * 分配时直接取用即可省去清零。池中的页在位图中是 [已占用] 的，描述符的引用计数为 1。
+ */
+#define PM_ZPOOL_SIZE   64
+
+static struct
+{
+    uint32_t count;
+    uintptr_t frames[PM_ZPOOL_SIZE];
+} pm_zpool;
+
+static struct pm_zero_stats pm_zstats;
+
+// 以 4 字节为单位的串存储清零一个页，比逐字节的 memset 快得多
+static inline void
+__pm_zero_page(void* va)
+{
+    uint32_t count = PG_SIZE / sizeof(uint32_t);
+    asm volatile("rep stosl"
+                 : "+D"(va), "+c"(count)
+                 : "a"(0)
+                 : "memory");
+}
+
+void*
+pmm_alloc_zeroed_page()
+{
+    uintptr_t ppn = 0;
+
+    reg32 eflags;
+    PM_LOCK(eflags)
+    if (pm_zpool.count) {
+        ppn = pm_zpool.frames[--pm_zpool.count];
+        pm_zstats.pool_hits++;
+    } else {
+        pm_zstats.pool_misses++;
+    }
+    PM_UNLOCK(eflags)
+
+    return (void*)(ppn << PG_SIZE_BITS);
+}
+
+size_t
+pmm_refill_zeroed_pool()
+{
+    size_t refilled = 0;
+
+    while (pm_zpool.count < PM_ZPOOL_SIZE) {
+        void* pa = pmm_alloc_page();
+        if (!pa) {
+            break;
+        }
+
+        // 直接映射区中的页可以直接清零，否则借用挂载窗口。
+        // 挂载窗口只有一个，清零期间关闭中断以独占它
+        void* va = phys_to_virt((uintptr_t)pa);
+        reg32 eflags;
+        if (va) {
+            __pm_zero_page(va);
+        } else {
+            eflags = cpu_disable_interrupt_save();
+            va = vmm_mount_page((void*)PG_MOUNT_1, pa);
+            if (va) {
+                __pm_zero_page(va);
+                vmm_unmount_page(va);
+            }
+            cpu_restore_interrupt(eflags);
+        }
+
+        if (!va) {
+            pmm_free_page(pa);
+            break;
+        }
+
+        PM_LOCK(eflags)
+        int full = pm_zpool.count == PM_ZPOOL_SIZE;
+        if (!full) {
+            pm_zpool.frames[pm_zpool.count++] = (uintptr_t)pa >> PG_SIZE_BITS;
+            pm_zstats.idle_zeroed++;
+        }
+        PM_UNLOCK(eflags)
+
+        if (full) {
+            pmm_free_page(pa);
+            break;
+        }
+        refilled++;
+    }
+
+    return refilled;
+}
+
+void
+pmm_zero_stats(struct pm_zero_stats* stats)
+{
+    reg32 eflags;
+    PM_LOCK(eflags)
+    *stats = pm_zstats;
+    PM_UNLOCK(eflags)
+}
+
+// 将长度为 run 的空闲段计入统计
+static void
+__pm_stats_run(struct pm_stats* stats, size_t run)
+{
+    if (!run) {
+        return;
+    }
+    if (run > stats->largest_run) {
+        stats->largest_run = run;
+    }
+
+    uint32_t bucket = 31 - __builtin_clz(run);
+    stats->run_hist[bucket < PM_STATS_HIST - 1 ? bucket : PM_STATS_HIST - 1]++;
+}
+
+void
+pmm_stats(struct pm_stats* stats)
+{
+    *stats = (struct pm_stats){ .total = max_pg };
+
+    reg32 eflags;
+    PM_LOCK(eflags)
+    for (int i = 0; i < PM_ZONE_COUNT; i++) {
+        stats->free += pm_zones[i].free_count;
+    }
+    for (int i = 0; i < CPU_MAX; i++) {
+        stats->cached += pm_magazines[i].count;
+        stats->alloc_pages += pm_cpu_stats[i].alloc_pages;
+        stats->free_pages += pm_cpu_stats[i].free_pages;
+    }
+    stats->cached += pm_zpool.count;
+    stats->reserved = pm_reserved_count;
+    stats->offline = max_pg - pm_online_end;
+    stats->scan_cycles = pm_scan_cycles;
+    stats->scan_count = pm_scan_count;
+    PM_UNLOCK(eflags)
+
+    // 页缓存与预清零页池不受 PM 锁保护，各项计数并非同一时刻的快照，相减可能为负
+    size_t accounted = stats->free + stats->cached + stats->reserved + stats->offline;
+    stats->used = stats->total > accounted ? stats->total - accounted : 0;
+
+    // 统计空闲段不持有锁：每个字的读取是原子的，结果只是一个近似的快照。
+    // 借助摘要位图，整段没有空闲页的 4MiB 一次跳过
+    size_t run = 0;
+    uint32_t words = (max_pg + PM_BMP_WORD_BITS - 1) / PM_BMP_WORD_BITS;
+    for (uint32_t g = 0; g < words; g++) {
+        if (!(g % PM_BMP_WORD_BITS) && !pm_summary_l1[g / PM_BMP_WORD_BITS]) {
+            __pm_stats_run(stats, run);
+            run = 0;
+            g += PM_BMP_WORD_BITS - 1;
+            continue;
+        }
+
+        uint32_t msk = __pm_word_free_mask(g);
+        if (msk == ~0U) {
+            run += PM_BMP_WORD_BITS;
+            continue;
+        }
+        for (uint32_t i = 0; i < PM_BMP_WORD_BITS; i++) {
+            if (msk & (1U << i)) {
+                run++;
+            } else {
+                __pm_stats_run(stats, run);
+                run = 0;
+            }
+        }
+    }
+    __pm_stats_run(stats, run);
+}
+
+/*
+ * 内存整理（Compaction）
+ *
+ * 长时间运行后，零散的单页分配会使位图中再也找不到大的空闲块，即使空闲页的总数足够。
+ * 整理时先选出一个已占用页最少、且这些页都可以迁移的对齐块，将其隔离，
+ *  再由 vmm_compact 把块中的页逐个复制到块外的新页上并改写页表项，最后整个块归还给位图。
+ * 只有 vmm_alloc_pages 映射的页是可迁移的：它们只通过一个页表项访问，没有人记录其物理地址。
+ */
+
+// 可迁移的页：内核的一般分配，未被共享、固定，也不属于 pmm_alloc_pages 分配的块
+static inline int
+__pm_movable(struct pm_page* pp)
+{
+    return pp->type == PP_KERNEL && pp->ref_count == 1 &&
+           (pp->flags & (PP_FL_MOVABLE | PP_FL_PINNED | PP_FL_BLOCK_HEAD)) ==
+             PP_FL_MOVABLE;
+}
+
+// 整理块 [ppn, ppn + count) 需要迁移的页数。页数不小于 limit，或者块中有不可迁移的页时返回 -1
+static int
+__pm_compact_cost(uintptr_t ppn, uint32_t count, int limit)
+{
+    int used = 0;
+    uintptr_t end = ppn + count;
+
+    // 先按字统计已占用的页数，大多数块在这一步就被淘汰了
+    for (uintptr_t p = ppn; p < end;) {
+        uint32_t offset = p % PM_BMP_WORD_BITS;
+        uint32_t n = PM_BMP_WORD_BITS - offset;
+        if (n > end - p) {
+            n = end - p;
+        }
+        used += __pm_popcount(pm_bitmap[p / PM_BMP_WORD_BITS] & PM_RUN_MASK(offset, n));
+        p += n;
+    }
+    if (used >= limit) {
+        return -1;
+    }
+
+    for (uintptr_t p = ppn; p < end; p++) {
+        if (!(pm_bitmap[p / PM_BMP_WORD_BITS] & (1U << (p % PM_BMP_WORD_BITS)))) {
+            continue;
+        }
+        struct pm_page* pp = PM_PAGE(p);
+        if (!pp || !__pm_movable(pp)) {
+            return -1;
+        }
+    }
+    return used;
+}
+
+void*
+pmm_compact_isolate(uint32_t order, int zone)
+{
+    if (!pm_pages || !order || order > PM_MAX_ORDER || zone < 0 ||
+        zone > ZONE_HIGH) {
+        return NULL;
+    }
+
+    uint32_t count = 1U << order;
+
+    // 页缓存中的页在位图中是 [已占用] 的，描述符却是 PP_FREE，先归还，以免整个块被判为不可迁移
+    reg32 eflags = cpu_disable_interrupt_save();
+    struct pm_magazine* mag = &pm_magazines[cpu_id()];
+    __pm_mag_drain(mag, mag->count);
+
+    spinlock_acquire(&pm_lock);
+
+    size_t free = 0;
+    for (int i = 0; i < PM_ZONE_COUNT; i++) {
+        free += pm_zones[i].free_count;
+    }
+
+    // 需要迁移的页超过块的一半就不值得了
+    uintptr_t best = 0;
+    int best_used = count >> 1;
+    for (int z = zone; z >= 0 && best_used; z--) {
+        // 第 0 个页永远不会被分配，含有它的块也就无法整理
+        uintptr_t lo = ROUNDUP(pm_zones[z].start_pg ? pm_zones[z].start_pg : 1, count);
+        uintptr_t hi = pm_zones[z].end_pg;
+        hi = hi < pm_online_end ? hi : pm_online_end;
+        hi = hi < max_pg ? hi : max_pg;
+
+        for (uintptr_t p = lo; p + count <= hi && best_used; p += count) {
+            int used = __pm_compact_cost(p, count, best_used);
+            if (used >= 0) {
+                best = p;
+                best_used = used;
+            }
+        }
+    }
+
+    // 迁移目标只能在块外，块外的空闲页也要足够
+    if (best && free - (count - best_used) < (size_t)best_used + PM_MAG_BATCH) {
+        best = 0;
+    }
+    if (best) {
+        __pm_mark_chunk(best, count, 1);
+    }
+
+    PM_UNLOCK(eflags)
+    return (void*)(best << PG_SIZE_BITS);
+}
+
+int
+pmm_compact_release(void* block, uint32_t order)
+{
+    uintptr_t start = (uintptr_t)block >> PG_SIZE_BITS;
+    uintptr_t end = start + (1U << order);
+    if (!pm_pages || !start || end > pm_pages_end) {
+        return 0;
+    }
+
+    int whole = 1;
+
+    reg32 eflags;
+    PM_LOCK(eflags)
+    uintptr_t run = start;
+    for (uintptr_t p = start; p < end; p++) {
+        if (PM_PAGE(p)->type == PP_FREE) {
+            continue;
+        }
+        // 迁移失败的页留在原处
+        if (run < p) {
+            __pm_mark_chunk(run, p - run, 0);
+        }
+        run = p + 1;
+        whole = 0;
+    }
+    if (run < end) {
+        __pm_mark_chunk(run, end - run, 0);
+    }
+    PM_UNLOCK(eflags)
+
+    return whole;
+}
+
+int
+pmm_fragmented()
+{
+    // 还有内存没有上线时，上线本身就能提供完整的块
+    if (__pm_has_deferred()) {
+        return 0;
+    }
+
+    size_t free = 0;
+    for (int i = 0; i < PM_ZONE_COUNT; i++) {
+        free += pm_zones[i].free_count;
+    }
+    return pm_buddy_tree[1] < PM_MAX_ORDER + 1 && free >= (2U << PM_MAX_ORDER);
+}
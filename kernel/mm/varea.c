@@ -0,0 +1,346 @@
+#include <awa/mm/page.h>
+#include <awa/mm/vmm.h>
+#include <awa/common.h>
+#include <awa/spike.h>
+
+#include <hal/cpu.h>
+
+/*
+ * 内核虚拟区域分配器
+ *
+ * [K_VAREA_START, K_VAREA_END) 被划分为一段段首尾相接的区间，或已保留，或空闲，相邻的空闲区间总是合并的。
+ * 所有区间按起始地址组织为一棵 AVL 树，每个结点另记录其子树中最大的空闲区间（max_free），
+ *  于是按地址查找是 O(log n)；分配时（first fit）跳过 max_free 不足的子树，
+ *  不考虑对齐时同样是 O(log n)。
+ * 区域在堆可用之前就要使用（例如重映射 VGA），结点取自一个静态的结点池。
+ */
+#define VAREA_NODES_MAX     256
+
+struct varea_node
+{
+    uintptr_t start;
+    size_t size;
+    size_t max_free;            // 子树中最大的空闲区间的字节数
+    struct varea_node* left;    // 在结点池的空闲链表中时，指向下一个空闲结点
+    struct varea_node* right;
+    int8_t height;
+    uint8_t used;
+};
+
+static struct varea_node varea_nodes[VAREA_NODES_MAX];
+static struct varea_node* varea_free_nodes;
+static size_t varea_free_count;
+static struct varea_node* varea_root;
+
+static struct varea_node*
+__varea_node_alloc(uintptr_t start, size_t size, int used)
+{
+    struct varea_node* n = varea_free_nodes;
+    if (!n) {
+        return NULL;
+    }
+    varea_free_nodes = n->left;
+    varea_free_count--;
+
+    *n = (struct varea_node){
+        .start = start,
+        .size = size,
+        .max_free = used ? 0 : size,
+        .height = 1,
+        .used = used,
+    };
+    return n;
+}
+
+static void
+__varea_node_free(struct varea_node* n)
+{
+    n->left = varea_free_nodes;
+    varea_free_nodes = n;
+    varea_free_count++;
+}
+
+static inline int
+__varea_height(struct varea_node* n)
+{
+    return n ? n->height : 0;
+}
+
+static inline size_t
+__varea_max_free(struct varea_node* n)
+{
+    return n ? n->max_free : 0;
+}
+
+// 由子结点重新计算高度与 max_free
+static void
+__varea_update(struct varea_node* n)
+{
+    int hl = __varea_height(n->left), hr = __varea_height(n->right);
+    n->height = (hl > hr ? hl : hr) + 1;
+
+    size_t m = n->used ? 0 : n->size;
+    size_t ml = __varea_max_free(n->left), mr = __varea_max_free(n->right);
+    if (ml > m) {
+        m = ml;
+    }
+    if (mr > m) {
+        m = mr;
+    }
+    n->max_free = m;
+}
+
+static struct varea_node*
+__varea_rotate_right(struct varea_node* n)
+{
+    struct varea_node* l = n->left;
+    n->left = l->right;
+    l->right = n;
+    __varea_update(n);
+    __varea_update(l);
+    return l;
+}
+
+static struct varea_node*
+__varea_rotate_left(struct varea_node* n)
+{
+    struct varea_node* r = n->right;
+    n->right = r->left;
+    r->left = n;
+    __varea_update(n);
+    __varea_update(r);
+    return r;
+}
+
+// 更新 n 并使其平衡，返回子树新的根
+static struct varea_node*
+__varea_balance(struct varea_node* n)
+{
+    __varea_update(n);
+    int bf = __varea_height(n->left) - __varea_height(n->right);
+    if (bf > 1) {
+        if (__varea_height(n->left->left) < __varea_height(n->left->right)) {
+            n->left = __varea_rotate_left(n->left);
+        }
+        return __varea_rotate_right(n);
+    }
+    if (bf < -1) {
+        if (__varea_height(n->right->right) < __varea_height(n->right->left)) {
+            n->right = __varea_rotate_right(n->right);
+        }
+        return __varea_rotate_left(n);
+    }
+    return n;
+}
+
+static struct varea_node*
+__varea_insert(struct varea_node* root, struct varea_node* n)
+{
+    if (!root) {
+        return n;
+    }
+    if (n->start < root->start) {
+        root->left = __varea_insert(root->left, n);
+    } else {
+        root->right = __varea_insert(root->right, n);
+    }
+    return __varea_balance(root);
+}
+
+// 从子树中摘下起始地址最小的结点，存入 min
+static struct varea_node*
+__varea_remove_min(struct varea_node* root, struct varea_node** min)
+{
+    if (!root->left) {
+        *min = root;
+        return root->right;
+    }
+    root->left = __varea_remove_min(root->left, min);
+    return __varea_balance(root);
+}
+
+// 从树中摘下起始地址为 start 的结点并归还给结点池
+static struct varea_node*
+__varea_remove(struct varea_node* root, uintptr_t start)
+{
+    if (!root) {
+        return NULL;
+    }
+    if (start < root->start) {
+        root->left = __varea_remove(root->left, start);
+    } else if (start > root->start) {
+        root->right = __varea_remove(root->right, start);
+    } else {
+        struct varea_node* l = root->left;
+        struct varea_node* r = root->right;
+        __varea_node_free(root);
+        if (!l || !r) {
+            return l ? l : r;
+        }
+
+        struct varea_node* m;
+        r = __varea_remove_min(r, &m);
+        m->left = l;
+        m->right = r;
+        root = m;
+    }
+    return __varea_balance(root);
+}
+
+// 区间的起始地址或大小改变后，沿着从根到它的路径更新 max_free
+static void
+__varea_touch(struct varea_node* root, uintptr_t start)
+{
+    if (!root) {
+        return;
+    }
+    if (start < root->start) {
+        __varea_touch(root->left, start);
+    } else if (start > root->start) {
+        __varea_touch(root->right, start);
+    }
+    __varea_update(root);
+}
+
+static struct varea_node*
+__varea_find(uintptr_t va)
+{
+    struct varea_node* n = varea_root;
+    while (n) {
+        if (va < n->start) {
+            n = n->left;
+        } else if (va - n->start >= n->size) {
+            n = n->right;
+        } else {
+            return n;
+        }
+    }
+    return NULL;
+}
+
+// 地址最低的、能容纳按 align 对齐的 size 个字节的空闲区间，对齐后的起始地址存入 addr
+static struct varea_node*
+__varea_first_fit(struct varea_node* n, size_t size, size_t align, uintptr_t* addr)
+{
+    if (!n || n->max_free < size) {
+        return NULL;
+    }
+
+    struct varea_node* found = __varea_first_fit(n->left, size, align, addr);
+    if (found) {
+        return found;
+    }
+
+    if (!n->used && n->size >= size) {
+        uintptr_t a = ROUNDUP(n->start, align);
+        if (a - n->start <= n->size - size) {
+            *addr = a;
+            return n;
+        }
+    }
+
+    return __varea_first_fit(n->right, size, align, addr);
+}
+
+void
+vmm_varea_init()
+{
+    varea_free_nodes = NULL;
+    varea_free_count = 0;
+    for (size_t i = 0; i < VAREA_NODES_MAX; i++) {
+        __varea_node_free(&varea_nodes[i]);
+    }
+    varea_root = __varea_node_alloc(K_VAREA_START, K_VAREA_END - K_VAREA_START, 0);
+}
+
+void*
+vmm_reserve_range(size_t size, size_t align)
+{
+    size = ROUNDUP(size, PG_SIZE);
+    align = align > PG_SIZE ? align : PG_SIZE;
+    if (!size || (align & (align - 1))) {
+        return NULL;
+    }
+
+    reg32 eflags = cpu_disable_interrupt_save();
+
+    // 一个空闲区间至多被分成三段，先确保结点够用
+    uintptr_t a;
+    struct varea_node* n = NULL;
+    if (varea_free_count >= 2) {
+        n = __varea_first_fit(varea_root, size, align, &a);
+    }
+    if (!n) {
+        cpu_restore_interrupt(eflags);
+        return NULL;
+    }
+
+    uintptr_t start = n->start, end = n->start + n->size;
+
+    // n 本身成为保留的区间，它的起始地址变大了，但仍位于前后两个区间之间，树的顺序不变
+    n->start = a;
+    n->size = size;
+    n->used = 1;
+    __varea_touch(varea_root, a);
+
+    if (a > start) {
+        varea_root = __varea_insert(varea_root, __varea_node_alloc(start, a - start, 0));
+    }
+    if (a + size < end) {
+        varea_root =
+          __varea_insert(varea_root, __varea_node_alloc(a + size, end - (a + size), 0));
+    }
+
+    cpu_restore_interrupt(eflags);
+    return (void*)a;
+}
+
+int
+vmm_release_range(void* va)
+{
+    reg32 eflags = cpu_disable_interrupt_save();
+
+    struct varea_node* n = __varea_find((uintptr_t)va);
+    if (!n || !n->used || n->start != (uintptr_t)va) {
+        cpu_restore_interrupt(eflags);
+        return 0;
+    }
+    n->used = 0;
+
+    // 与前后的空闲区间合并。先把邻居摘下，n 的起始地址才能移动到它的位置
+    struct varea_node* prev = __varea_find(n->start - 1);
+    if (prev && !prev->used) {
+        uintptr_t start = prev->start;
+        size_t size = prev->size;
+        varea_root = __varea_remove(varea_root, start);
+        n->start = start;
+        n->size += size;
+    }
+
+    struct varea_node* next = __varea_find(n->start + n->size);
+    if (next && !next->used) {
+        size_t size = next->size;
+        varea_root = __varea_remove(varea_root, next->start);
+        n->size += size;
+    }
+    __varea_touch(varea_root, n->start);
+
+    cpu_restore_interrupt(eflags);
+    return 1;
+}
+
+v_area
+vmm_lookup_range(void* va)
+{
+    v_area area = { .start = NULL, .size = 0 };
+
+    reg32 eflags = cpu_disable_interrupt_save();
+    struct varea_node* n = __varea_find((uintptr_t)va);
+    if (n && n->used) {
+        area.start = (void*)n->start;
+        area.size = n->size;
+    }
+    cpu_restore_interrupt(eflags);
+
+    return area;
+}
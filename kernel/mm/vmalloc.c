@@ -0,0 +1,51 @@
+/**
+ * @file vmalloc.c
+ * @brief 虚拟地址连续、物理页分散的内核分配。
+ *
+ * 地址取自内核虚拟区域（见 varea.c），每个页单独向 PMM 申请，释放时全部归还。
+ * 与 lxmalloc 不同，释放后不会有内存滞留在堆中，适合大的、短期使用的缓冲区。
+ */
+#include <awa/mm/kalloc.h>
+#include <awa/mm/page.h>
+#include <awa/mm/vmm.h>
+#include <awa/common.h>
+#include <awa/spike.h>
+
+void*
+vmalloc(size_t size)
+{
+    if (!size || size > K_VAREA_END - K_VAREA_START) {
+        return NULL;
+    }
+    size = ROUNDUP(size, PG_SIZE);
+
+    // 末尾多保留一页但不映射，作为保护页：越界写入会立即引发缺页，而不是破坏相邻的分配
+    void* va = vmm_reserve_range(size + PG_SIZE, PG_SIZE);
+    if (!va) {
+        return NULL;
+    }
+
+    // 失败时 vmm_alloc_pages 已归还了分配到的物理页
+    if (!vmm_alloc_pages(va, size, PG_PREM_RW)) {
+        vmm_release_range(va);
+        return NULL;
+    }
+
+    return va;
+}
+
+void
+vfree(void* ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    v_area area = vmm_lookup_range(ptr);
+    if (area.start != ptr) {
+        return;
+    }
+
+    vmm_unmap_range(ptr, area.size - PG_SIZE);
+    vmm_release_range(ptr);
+}
@@ -3,54 +3,237 @@
 #include <awa/mm/page.h>
 #include <awa/mm/pmm.h>`
 #include <awa/mm/vmm.h>
+#include <awa/mm/ioremap.h>
+#include <awa/mm/memblock.h>
 #include <awa/spike.h>
 
 #include <stdbool.h>
 
+uintptr_t vmm_direct_pfns;
+
+// PAT 是否已按 page.h 中的约定设置，否则 PG_MEM_WC 退化为 PG_MEM_UC_MINUS
+static int vmm_has_pat;
+
+// PAT 各项的内存类型编码
+#define PAT_UC          0x00
+#define PAT_WC          0x01
+#define PAT_WT          0x04
+#define PAT_WB          0x06
+#define PAT_UC_MINUS    0x07
+
+#define PAT_ENTRIES(t0, t1, t2, t3) ((t0) | ((t1) << 8) | ((t2) << 16) | ((t3) << 24))
+
 void
 vmm_init()
 {
-    // TODO: something here?
+    // 写时复制依赖内核态写入只读页时同样引发缺页
+    cpu_lcr0(cpu_rcr0() | CR0_WP);
+
+    // 只改动 PA4，已有的映射都不使用它，所以无需先关闭缓存
+    if (cpu_has_pat()) {
+        cpu_wrmsr(IA32_PAT_MSR,
+                  PAT_ENTRIES(PAT_WC, PAT_WT, PAT_UC_MINUS, PAT_UC),
+                  PAT_ENTRIES(PAT_WB, PAT_WT, PAT_UC_MINUS, PAT_UC));
+        cpu_invtlb_all();
+        vmm_has_pat = 1;
+    }
+
+    vmm_varea_init();
+}
+
+// 大页是否可用：PAE 下总是可用，否则须由 hhk 开启 CR4.PSE
+static int
+__vmm_has_large_pages()
+{
+#ifdef CONFIG_PAE
+    return 1;
+#else
+    return cpu_rcr4() & CR4_PSE;
+#endif
+}
+
+// 新建页表项时使用的权限：内核空间（递归映射区域除外）在 hhk 开启了 CR4.PGE 时带上 PG_GLOBAL，
+//  重载 CR3 时这些 TLB 项不会被刷掉。递归映射区域随地址空间变化，用户页同样不能是全局的。
+// 没有 PAT 时 PG_PAT 是保留位，PG_MEM_WC 换成 PG_MEM_UC_MINUS
+static pt_attr
+__vmm_leaf_attr(uint32_t l1_index, pt_attr attr)
+{
+    if ((attr & PG_PAT) && !vmm_has_pat) {
+        attr = (attr & ~PG_MEM_MASK) | PG_MEM_UC_MINUS;
+    }
+
+    if (l1_index < L1_INDEX(HIGHER_HLF_BASE) || l1_index >= PG_L1_RECURSIVE ||
+        (attr & PG_ALLOW_USER)) {
+        return attr;
+    }
+    return (cpu_rcr4() & CR4_PGE) ? (attr | PG_GLOBAL) : attr;
+}
+
+void
+vmm_init_direct_map(uintptr_t max_pfn)
+{
+    uintptr_t pfns = K_DIRECT_MAP_SIZE >> PG_SIZE_BITS;
+    if (max_pfn < pfns) {
+        pfns = max_pfn;
+    }
+
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR;
+    int large = __vmm_has_large_pages();
+    pt_attr attr = __vmm_leaf_attr(L1_INDEX(HIGHER_HLF_BASE), PG_PREM_RW);
+    uintptr_t pfn = 0;
+    while (pfn < pfns) {
+        uintptr_t va = P2V(pfn << PG_SIZE_BITS);
+        uint32_t l1_index = L1_INDEX(va);
+        x86_pte_t l1pte = l1pt->entry[l1_index];
+
+        // 内核映像所在的大页已由 hhk 建立
+        if (IS_LARGE_PDE(l1pte)) {
+            pfn += 1U << PG_LARGE_ORDER;
+            continue;
+        }
+
+        if (!l1pte && large) {
+            l1pt->entry[l1_index] =
+              NEW_L2_ENTRY_PA(attr | PG_PDE_4MB, (paddr_t)pfn << PG_SIZE_BITS);
+            pfn += 1U << PG_LARGE_ORDER;
+            continue;
+        }
+
+        // 没有大页可用，或者 hhk 已为内核建立了页表：逐页映射
+        if (!l1pte) {
+            paddr_t pt = memblock_alloc_phys(PG_SIZE, PG_SIZE);
+            if (!pt) {
+                break;
+            }
+            l1pt->entry[l1_index] = NEW_L2_ENTRY_PA(PG_PREM_RW, pt);
+            cpu_invplg((void*)L2_VADDR(l1_index));
+            memset((void*)L2_VADDR(l1_index), 0, PG_SIZE);
+        }
+
+        x86_page_table* l2pt = (x86_page_table*)L2_VADDR(l1_index);
+        for (uint32_t i = L2_INDEX(va); i < PG_MAX_ENTRIES && pfn < pfns; i++, pfn++) {
+            l2pt->entry[i] = NEW_L2_ENTRY_PA(attr, (paddr_t)pfn << PG_SIZE_BITS);
+        }
+    }
+
+    vmm_direct_pfns = pfn < pfns ? pfn : pfns;
+    cpu_invtlb_all();
+}
+
+// 物理地址被交给了调用者（又建立了一个映射，或者经由 vmm_lookup 得到），
+//  此后可能经由内存整理看不到的途径访问它，不能再迁移
+static inline void
+__vmm_pin_frame(uintptr_t ppn)
+{
+    struct pm_page* pp = pmm_frame(ppn);
+    if (pp) {
+        pp->flags &= ~PP_FL_MOVABLE;
+    }
+}
+
+// 分配一个页用作页表（或页目录），它位于直接映射区中，返回其物理地址
+static void*
+__vmm_alloc_table()
+{
+    // 优先使用预清零的页，但只有在直接映射区中的才行
+    void* pa = pmm_alloc_zeroed_page();
+    if (pa && !phys_to_virt((uintptr_t)pa)) {
+        pmm_free_page(pa);
+        pa = NULL;
+    }
+
+    if (!pa) {
+        pa = pmm_alloc_page_zone(ZONE_NORMAL);
+        if (!pa) {
+            return NULL;
+        }
+        memset(phys_to_virt((uintptr_t)pa), 0, PG_SIZE);
+    }
+
+    struct pm_page* pp = pmm_page(pa);
+    if (pp) {
+        pp->type = PP_PAGETABLE;
+    }
+    return pa;
 }
 
 // 创建 并 返回 一个 可立即使用 的页目录 物理地址
 x86_page_table*
 vmm_init_pd()
 {
-    x86_page_table* dir = (x86_page_table*)pmm_alloc_page();
-    for (size_t i = 0; i < PG_MAX_ENTRIES; i++) {
-        dir->entry[i] = PTE_NULL;
+    void* dir_pa = __vmm_alloc_table();
+    if (!dir_pa) {
+        return NULL;
     }
+    x86_page_table* dir = phys_to_virt((uintptr_t)dir_pa);
 
+#ifdef CONFIG_PAE
+    // PAE：dir 为 PDPT，另需四个页目录，递归映射建立在最后一个页目录的最后四项上（见 page.h）
+    void* pds[PG_L1_TABLES];
+    for (size_t i = 0; i < PG_L1_TABLES; i++) {
+        pds[i] = __vmm_alloc_table();
+        if (!pds[i]) {
+            while (i--) {
+                pmm_free_page(pds[i]);
+            }
+            pmm_free_page(dir_pa);
+            return NULL;
+        }
+        dir->entry[i] = NEW_L1_ENTRY(PG_PRESENT, pds[i]);
+    }
+    x86_page_table* last = phys_to_virt((uintptr_t)pds[PG_L1_TABLES - 1]);
+    for (size_t i = 0; i < PG_L1_TABLES; i++) {
+        last->entry[PG_MAX_ENTRIES - PG_L1_TABLES + i] = NEW_L1_ENTRY(T_SELF_REF_PERM, pds[i]);
+    }
+#else
     // 递归映射，方便我们在软件层面进行查表地址转换
-    dir->entry[PG_MAX_ENTRIES - 1] = NEW_L1_ENTRY(T_SELF_REF_PERM, dir);
+    dir->entry[PG_MAX_ENTRIES - 1] = NEW_L1_ENTRY(T_SELF_REF_PERM, dir_pa);
+#endif
 
-    return dir;
+    return dir_pa;
 }
 
-int
-__vmm_map_internal(uint32_t l1_inx,
-                   uint32_t l2_inx,
-                   uintptr_t pa,
-                   pt_attr attr,
-                   int forced)
+// 一级页表第 l1_inx 项所指的页表，不存在时分配一个。
+// 该项为大页、属于递归映射区域或者物理内存不足时返回 NULL
+static x86_page_table*
+__vmm_get_table(uint32_t l1_inx, pt_attr attr)
 {
-    x86_page_table* l1pt = (x86_page_table*)L1_BASE_VADDR;
-    x86_page_table* l2pt = (x86_page_table*)L2_VADDR(l1_inx);
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR;
 
-    // See if attr make sense
-    assert(attr <= 128);
+    // 大页中的 4KiB 页不能单独映射
+    if (l1_inx >= PG_L1_RECURSIVE || IS_LARGE_PDE(l1pt->entry[l1_inx])) {
+        return NULL;
+    }
 
     if (!l1pt->entry[l1_inx]) {
-        x86_page_table* new_l1pt_pa = pmm_alloc_page();
+        // 页表在挂上之前就经由直接映射区清零了
+        void* new_l1pt_pa = __vmm_alloc_table();
 
         // 物理内存已满！
         if (!new_l1pt_pa) {
-            return 0;
+            return NULL;
         }
 
-        l1pt->entry[l1_inx] = NEW_L1_ENTRY(attr, new_l1pt_pa);
-        memset((void*)L2_VADDR(l1_inx), 0, PG_SIZE);
+        // 页目录项总是可写的，读写权限由页表项决定
+        l1pt->entry[l1_inx] = NEW_L1_ENTRY(PG_PREM_RW | (attr & PG_ALLOW_USER), new_l1pt_pa);
+    }
+
+    return (x86_page_table*)L2_VADDR(l1_inx);
+}
+
+int
+__vmm_map_internal(uint32_t l1_inx,
+                   uint32_t l2_inx,
+                   paddr_t pa,
+                   pt_attr attr,
+                   int forced)
+{
+    // See if attr make sense
+    assert(attr <= 0xFF);
+
+    x86_page_table* l2pt = __vmm_get_table(l1_inx, attr);
+    if (!l2pt) {
+        return 0;
     }
 
     x86_pte_t l2pte = l2pt->entry[l2_inx];
@@ -59,17 +242,27 @@ __vmm_map_internal(uint32_t l1_inx,
             return 0;
         }
         if (HAS_FLAGS(l2pte, PG_PRESENT)) {
-            assert_msg(pmm_free_page(GET_PG_ADDR(l2pte)), "fail to release physical page");
+            assert_msg(pmm_free_frame(PG_ENTRY_PPN(l2pte)), "fail to release physical page");
         }
     }
 
-    l2pt->entry[l2_inx] = NEW_L2_ENTRY(attr, pa);
+    l2pt->entry[l2_inx] = NEW_L2_ENTRY_PA(__vmm_leaf_attr(l1_inx, attr), pa);
+    __vmm_pin_frame((uintptr_t)(pa >> PG_SIZE_BITS));
 
     return 1;
 }
 
 //尝试将 物理页 映射到 虚拟页
-//若目标虚拟页已映射，则寻找更大且未使用的地址进行映射
+//若目标虚拟页已映射，则从内核虚拟区域中另取一页进行映射
+// vmm_map_page 另取的地址（表项带有 PG_VAREA_ALT）在解除映射时归还给虚拟区域分配器
+static void
+__vmm_release_alt(void* va, x86_pte_t pte)
+{
+    if (pte & PG_VAREA_ALT) {
+        vmm_release_range(va);
+    }
+}
+
 void*
 vmm_map_page(void* va, void* pa, pt_attr tattr)
 {
@@ -128,58 +321,39 @@ vmm_map_page(void* va, void* pa, pt_attr tattr)
     uint32_t l1_index = L1_INDEX(va); //获取 并 保存 虚拟页目录索引 PDE
     //获得二级目录索引
     uint32_t l2_index = L2_INDEX(va); //获取 并 保存 虚拟页表索引 PTE
-    x86_page_table* l1pt = (x86_page_table*)L1_BASE_VADDR; //定义页目录
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR; //定义页目录
     /*
     L1_BASE_VADDR = 0xFFFFF000U 指向 PTD本身
     x86_pte_t l1pte = l1pt->entry[l1_index];
     l1pt->entry[l1_index]相当于在ptd页目录表中指向其中一个页目录项(页表PT)
     */
 
-    // 在页表与页目录中找到一个可用的空位进行映射（位于va或其附近）
-    
-/*
-
-  l1pt  ptd + 0xFFFFF000 | 0x003FF000 | 0x00000000
-                ptd?          页表？        页表项？
-
-  l2pt  ptd + 0xFFFFF000 | 0xnnnnnnnn | 0x00000000
-                                A
-                                |
-                            l1_index << 12
-*/    
-
-
     // 即 l1pt = l1t[1023][1023]
-    // l1pte = l1t[1023][1023][l1_index]可能没写对
     x86_pte_t l1pte = l1pt->entry[l1_index];// 访问 页表数组 从而获得PTE 相当于0xFFFFF000 + l1_index * 4
     // 即 l2pt = l1t[1023][l1_index]
-    // l2pte = l1t[1023][l1_index][l2_index]
     x86_page_table* l2pt = (x86_page_table*)L2_VADDR(l1_index);//L2_VADDR(l1_index)相当于l1t[1023][l1_index]
-    while (l1pte && l1_index < PG_MAX_ENTRIES) {
-        if (l2_index == PG_MAX_ENTRIES) {
-            l1_index++;
-            l2_index = 0;
-            l1pte = l1pt->entry[l1_index];//可能没写对
-            l2pt = (x86_page_table*)L2_VADDR(l1_index);
-        }
-        // 页表有空位，只需要开辟一个新的 PTE (Level 2)
-        if (l2pt && !l2pt->entry[l2_index]) {
-            l2pt->entry[l2_index] = NEW_L2_ENTRY(tattr, pa);
-            return (void*)V_ADDR(l1_index, l2_index, PG_OFFSET(va));
+
+    // va 本身空闲时直接映射（不能越过递归映射区域，大页中也没有空位）
+    if (l1_index < PG_L1_RECURSIVE && !IS_LARGE_PDE(l1pte) &&
+        (!l1pte || !l2pt->entry[l2_index])) {
+        if (!__vmm_map_internal(l1_index, l2_index, (uintptr_t)pa, tattr, false)) {
+            return NULL;
         }
-        l2_index++;
+        return va;
     }
 
-    // 页目录与所有页表已满！
-    if (l1_index > PG_MAX_ENTRIES) {
+    // 否则由虚拟区域分配器另取一页，而不是逐项扫描页表寻找空位
+    void* alt = vmm_reserve_range(PG_SIZE, PG_SIZE);
+    if (!alt) {
         return NULL;
     }
-
-    if (!__vmm_map_internal(l1_index, l2_index, (uintptr_t)pa, tattr, false)) {
+    if (!__vmm_map_internal(L1_INDEX(alt), L2_INDEX(alt), (uintptr_t)pa, tattr, false)) {
+        vmm_release_range(alt);
         return NULL;
     }
+    ((x86_page_table*)L2_VADDR(L1_INDEX(alt)))->entry[L2_INDEX(alt)] |= PG_VAREA_ALT;
 
-    return (void*)V_ADDR(l1_index, l2_index, PG_OFFSET(va));
+    return alt;
 }
 
 // “强制” 将 物理页 映射到 特定 虚拟页 (若已存在，则覆盖)
@@ -204,6 +378,259 @@ vmm_fmap_page(void* va, void* pa, pt_attr tattr)
     return (void*)V_ADDR(l1_index, l2_index, PG_OFFSET(va));
 }
 
+// 一级页表第 l1_index 项所指的页表中是否已没有任何映射
+static int
+__vmm_table_empty(uint32_t l1_index)
+{
+    x86_page_table* l2pt = (x86_page_table*)L2_VADDR(l1_index);
+    for (size_t i = 0; i < PG_MAX_ENTRIES; i++) {
+        if (l2pt->entry[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void*
+vmm_map_large_page(void* va, paddr_t pa, pt_attr tattr)
+{
+    if (((uintptr_t)va & (PG_LARGE_SIZE - 1)) || (pa & (PG_LARGE_SIZE - 1))) {
+        return NULL;
+    }
+
+    uint32_t l1_index = L1_INDEX(va);
+    if (l1_index >= PG_L1_RECURSIVE || !__vmm_has_large_pages()) {
+        return NULL;
+    }
+
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR;
+    x86_pte_t l1pte = l1pt->entry[l1_index];
+    if (l1pte) {
+        if (IS_LARGE_PDE(l1pte) || !__vmm_table_empty(l1_index)) {
+            return NULL;
+        }
+
+        // 页表已经空了（例如之前的映射都已解除），回收它，换成大页
+        l1pt->entry[l1_index] = PTE_NULL;
+        cpu_invplg((void*)L2_VADDR(l1_index));
+        pmm_free_frame(PG_ENTRY_PPN(l1pte));
+    }
+
+    // 4KiB 页表项的 PAT 位在大页中是 PS，大页的 PAT 位另在第 12 位
+    pt_attr attr = __vmm_leaf_attr(l1_index, tattr);
+    x86_pte_t l1e = NEW_L2_ENTRY_PA((attr & ~PG_PAT) | PG_PDE_4MB, pa);
+    if (attr & PG_PAT) {
+        l1e |= PG_LARGE_PAT;
+    }
+    l1pt->entry[l1_index] = l1e;
+    cpu_invplg(va);
+
+    return va;
+}
+
+// 解除一级页表第 l1_index 项上的大页映射，release 时释放其物理块
+static void
+__vmm_unmap_large(uint32_t l1_index, int release)
+{
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR;
+    x86_pte_t l1pte = l1pt->entry[l1_index];
+    l1pt->entry[l1_index] = PTE_NULL;
+    cpu_invplg((void*)V_ADDR(l1_index, 0, 0));
+    if (!release) {
+        return;
+    }
+
+    // 由 pmm_alloc_pages 分配的块才能释放；启动时的内核映射、MMIO 等会被 PMM 拒绝
+    paddr_t pa = PG_LARGE_ADDR(l1pte);
+#ifdef CONFIG_PAE
+    if (pa >= ((paddr_t)PM_ZONE_HIGH_END << PG_SIZE_BITS)) {
+        return;
+    }
+#endif
+    pmm_free_pages((void*)(uintptr_t)pa, PG_LARGE_ORDER);
+}
+
+/*
+ * 延迟的 TLB 刷新
+ *
+ * 批量解除映射时，先只修改页表项，把失效的虚拟页与待释放的物理页记在 vmm_gather 中，
+ *  最后统一刷新：页数不多时逐页 invlpg，超过 VMM_FLUSH_CEILING 时重载 CR3 反而更快。
+ *  重载 CR3 刷不掉全局页，涉及内核空间时要改用 cpu_invtlb_all（invlpg 对全局页同样有效）。
+ * 物理页必须在刷新之后才能释放，否则可能有人经由残留的 TLB 项写入已被重新分配的页。
+ * 新建映射时（原页表项为空）无需刷新，x86 不会缓存不存在的页表项。
+ */
+#define VMM_FLUSH_CEILING   32
+
+struct vmm_gather
+{
+    void* pages[VMM_FLUSH_CEILING];
+    size_t page_count;      // 可以超过 VMM_FLUSH_CEILING，此时只记数
+    uintptr_t frames[VMM_FLUSH_CEILING];
+    size_t frame_count;
+    int global;             // 是否有内核空间的页，它们可能是全局页
+};
+
+static void
+__vmm_gather_flush(struct vmm_gather* g)
+{
+    if (g->page_count > VMM_FLUSH_CEILING) {
+        if (g->global) {
+            cpu_invtlb_all();
+        } else {
+            cpu_invtlb();
+        }
+    } else {
+        for (size_t i = 0; i < g->page_count; i++) {
+            cpu_invplg(g->pages[i]);
+        }
+    }
+    g->page_count = 0;
+    g->global = 0;
+
+    pmm_free_frames_bulk(g->frame_count, g->frames);
+    g->frame_count = 0;
+}
+
+static inline void
+__vmm_gather_page(struct vmm_gather* g, void* va)
+{
+    if (g->page_count < VMM_FLUSH_CEILING) {
+        g->pages[g->page_count] = va;
+    }
+    g->page_count++;
+    g->global |= (uintptr_t)va >= HIGHER_HLF_BASE;
+}
+
+static inline void
+__vmm_gather_frame(struct vmm_gather* g, uintptr_t ppn)
+{
+    if (g->frame_count == VMM_FLUSH_CEILING) {
+        __vmm_gather_flush(g);
+    }
+    g->frames[g->frame_count++] = ppn;
+}
+
+int
+vmm_map_range(void* va, paddr_t pa, size_t sz, pt_attr attr)
+{
+    assert(((uintptr_t)va & 0xFFFU) == 0) assert((pa & 0xFFFU) == 0);
+
+    size_t count = sz >> PG_SIZE_BITS;
+    uintptr_t va_ = (uintptr_t)va;
+    for (size_t i = 0; i < count;) {
+        uint32_t l1_index = L1_INDEX(va_);
+        uint32_t l2_index = L2_INDEX(va_);
+        size_t n = PG_MAX_ENTRIES - l2_index;
+        if (n > count - i) {
+            n = count - i;
+        }
+
+        x86_pte_t l1pte = ((x86_page_dir*)L1_BASE_VADDR)->entry[l1_index];
+        if (l1_index < PG_L1_RECURSIVE && IS_LARGE_PDE(l1pte)) {
+            // 已被大页覆盖，与 vmm_set_mapping 一样保持原样
+            i += n;
+            va_ += n << PG_SIZE_BITS;
+            pa += (paddr_t)n << PG_SIZE_BITS;
+            continue;
+        }
+
+        // 每个页表只查找（或分配）一次
+        x86_page_table* l2pt = __vmm_get_table(l1_index, attr);
+        if (!l2pt) {
+            return 0;
+        }
+        pt_attr leaf = __vmm_leaf_attr(l1_index, attr);
+        for (uint32_t j = l2_index; j < l2_index + n; j++) {
+            if (!l2pt->entry[j]) {
+                l2pt->entry[j] = NEW_L2_ENTRY_PA(leaf, pa);
+                __vmm_pin_frame((uintptr_t)(pa >> PG_SIZE_BITS));
+            }
+            pa += PG_SIZE;
+        }
+        i += n;
+        va_ += n << PG_SIZE_BITS;
+    }
+
+    return 1;
+}
+
+static void
+__vmm_unmap_range(void* va, size_t sz, int release)
+{
+    assert(((uintptr_t)va & 0xFFFU) == 0);
+
+    struct vmm_gather g = { .page_count = 0, .frame_count = 0 };
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR;
+    size_t count = sz >> PG_SIZE_BITS;
+    uintptr_t va_ = (uintptr_t)va;
+    for (size_t i = 0; i < count;) {
+        uint32_t l1_index = L1_INDEX(va_);
+        uint32_t l2_index = L2_INDEX(va_);
+        size_t n = PG_MAX_ENTRIES - l2_index;
+        if (n > count - i) {
+            n = count - i;
+        }
+
+        // prevent unmap of recursive mapping region
+        if (l1_index >= PG_L1_RECURSIVE) {
+            break;
+        }
+
+        x86_pte_t l1pte = l1pt->entry[l1_index];
+        if (IS_LARGE_PDE(l1pte)) {
+            // 同 vmm_unmap_page：范围包含大页的起始地址时解除整个大页
+            if (!l2_index) {
+                __vmm_unmap_large(l1_index, release);
+            }
+        } else if (l1pte) {
+            x86_page_table* l2pt = (x86_page_table*)L2_VADDR(l1_index);
+            for (uint32_t j = l2_index; j < l2_index + n; j++) {
+                x86_pte_t l2pte = l2pt->entry[j];
+                if (!l2pte) {
+                    continue;
+                }
+                l2pt->entry[j] = PTE_NULL;
+                __vmm_gather_page(&g, (void*)V_ADDR(l1_index, j, 0));
+                if (release && IS_CACHED(l2pte)) {
+                    __vmm_gather_frame(&g, PG_ENTRY_PPN(l2pte));
+                }
+                // vmm_map_page 另取的地址归还之前，它的 TLB 项必须已经失效
+                if (l2pte & PG_VAREA_ALT) {
+                    void* alt = (void*)V_ADDR(l1_index, j, 0);
+                    cpu_invplg(alt);
+                    __vmm_release_alt(alt, l2pte);
+                }
+            }
+        }
+        i += n;
+        va_ += n << PG_SIZE_BITS;
+    }
+
+    __vmm_gather_flush(&g);
+}
+
+void
+vmm_unmap_range(void* va, size_t sz)
+{
+    __vmm_unmap_range(va, sz, true);
+}
+
+void
+vmm_unmount_range(void* va, size_t sz)
+{
+    __vmm_unmap_range(va, sz, false);
+}
+
+// 只映射在一个虚拟页上、没有人记录其物理地址的页，内存整理时可以迁移
+static inline void
+__vmm_set_movable(uintptr_t ppn)
+{
+    struct pm_page* pp = pmm_frame(ppn);
+    if (pp) {
+        pp->flags |= PP_FL_MOVABLE;
+    }
+}
+
 //为给定的 虚拟页 分配一个可用的 物理页
 void*
 vmm_alloc_page(void* vpn, pt_attr tattr)
@@ -212,29 +639,94 @@ vmm_alloc_page(void* vpn, pt_attr tattr)
     void* result = vmm_map_page(vpn, pp, tattr);
     if (!result) {
         pmm_free_page(pp);
+        return NULL;
     }
+    __vmm_set_movable((uintptr_t)pp >> PG_SIZE_BITS);
     return result;
 }
 
 // 分配多个连续的 虚拟页
-int
-vmm_alloc_pages(void* va, size_t sz, pt_attr tattr)
+// vmm_alloc_pages 每批向 PMM 批量申请的物理页数
+#define VMM_ALLOC_BATCH 32
+
+static int
+__vmm_alloc_pages(void* va, size_t sz, pt_attr tattr, int zeroed)
 {
     assert((uintptr_t)va % PG_SIZE == 0) assert(sz % PG_SIZE == 0);
 
+    // 以物理页号记录，PAE 下这些页可以在 4GiB 以上
+    uintptr_t frames[VMM_ALLOC_BATCH];
+    size_t count = sz >> PG_SIZE_BITS;
     void* va_ = va;
-    for (size_t i = 0; i < (sz >> PG_SIZE_BITS); i++, va_ += PG_SIZE) {
-        void* pp = pmm_alloc_page();
-        uint32_t l1_index = L1_INDEX(va_);
-        uint32_t l2_index = L2_INDEX(va_);
-        if (!pp || !__vmm_map_internal(
-                     l1_index, l2_index, (uintptr_t)pp, tattr, false)) {
-            // if one failed, release previous allocated pages.
-            va_ = va;
-            for (size_t j = 0; j < i; j++, va_ += PG_SIZE) {
-                vmm_unmap_page(va_);
+    for (size_t i = 0; i < count;) {
+        // 剩余部分覆盖了一个对齐的大页时，尝试用一个物理连续的块整体映射。
+        // 块本身是对齐的，所以页着色开启时，各个颜色依然均匀。
+        // 没有现成的块就退回 4KiB 页，不值得为此归还页缓存或整理内存
+        if (count - i >= (1U << PG_LARGE_ORDER) &&
+            !((uintptr_t)va_ & (PG_LARGE_SIZE - 1)) && __vmm_has_large_pages()) {
+            void* blk = pmm_try_alloc_pages(PG_LARGE_ORDER);
+            if (blk && vmm_map_large_page(va_, (uintptr_t)blk, tattr)) {
+                if (zeroed) {
+                    memset(va_, 0, PG_LARGE_SIZE);
+                }
+                i += 1U << PG_LARGE_ORDER;
+                va_ += PG_LARGE_SIZE;
+                continue;
+            }
+            if (blk) {
+                pmm_free_pages(blk, PG_LARGE_ORDER);
+            }
+        }
+
+        size_t n = count - i;
+        if (n > VMM_ALLOC_BATCH) {
+            n = VMM_ALLOC_BATCH;
+        }
+
+        size_t pooled = 0;
+        size_t got = 0;
+        if (pmm_colors()) {
+            // 页着色：第 k 个虚拟页使用颜色为 k 的物理页，连续的虚拟页均匀地落在各个缓存组上
+            uintptr_t vpn = (uintptr_t)va_ >> PG_SIZE_BITS;
+            void* pg;
+            while (got < n && (pg = pmm_alloc_page_color(vpn + got))) {
+                frames[got++] = (uintptr_t)pg >> PG_SIZE_BITS;
+            }
+        } else {
+            // 需要全零的页时，先从预清零页池中取，前 pooled 个页无需再清零
+            void* pg;
+            while (zeroed && pooled < n && (pg = pmm_alloc_zeroed_page())) {
+                frames[pooled++] = (uintptr_t)pg >> PG_SIZE_BITS;
             }
 
+            // 每批物理页只需扫描一次位图。这些页只经由页表访问，PAE 下可以来自 4GiB 以上
+            got = pooled + pmm_alloc_frames_bulk(n - pooled, &frames[pooled]);
+        }
+        // 页表只在跨入新的页表时查找一次
+        x86_page_table* l2pt = NULL;
+        pt_attr leaf = tattr;
+        size_t j = 0;
+        for (; j < got; j++, i++, va_ += PG_SIZE) {
+            uint32_t l2_index = L2_INDEX(va_);
+            if (!l2pt || !l2_index) {
+                l2pt = __vmm_get_table(L1_INDEX(va_), tattr);
+                leaf = __vmm_leaf_attr(L1_INDEX(va_), tattr);
+            }
+            if (!l2pt || l2pt->entry[l2_index]) {
+                break;
+            }
+            l2pt->entry[l2_index] = NEW_L2_ENTRY_PA(leaf, (paddr_t)frames[j] << PG_SIZE_BITS);
+            __vmm_set_movable(frames[j]);
+            if (zeroed && j >= pooled) {
+                memset(va_, 0, PG_SIZE);
+            }
+        }
+
+        if (j < n) {
+            // if one failed, release unused frames and previous allocated pages.
+            pmm_free_frames_bulk(got - j, &frames[j]);
+            vmm_unmap_range(va, i << PG_SIZE_BITS);
+
             return false;
         }
     }
@@ -242,6 +734,376 @@ vmm_alloc_pages(void* va, size_t sz, pt_attr tattr)
     return true;
 }
 
+int
+vmm_alloc_pages(void* va, size_t sz, pt_attr tattr)
+{
+    return __vmm_alloc_pages(va, sz, tattr, false);
+}
+
+int
+vmm_alloc_zeroed_pages(void* va, size_t sz, pt_attr tattr)
+{
+    return __vmm_alloc_pages(va, sz, tattr, true);
+}
+
+/*
+ * 按需分配的区域（如内核堆）：只保留虚拟地址，物理页在首次访问引发缺页时才分配并清零。
+ * 区域很少，也几乎不会变动，用一个小数组记录就够了。
+ */
+#define VMM_LAZY_MAX        8
+
+#define PF_PRESENT          0x1     // 缺页错误码：由保护违例引起，而非页不存在
+#define PF_WRITE            0x2     // 缺页错误码：由写入引起
+
+struct vmm_lazy_region
+{
+    uintptr_t start;
+    uintptr_t end;
+    pt_attr attr;
+};
+
+static struct vmm_lazy_region vmm_lazy[VMM_LAZY_MAX];
+static uint32_t vmm_lazy_count;
+
+static struct vmm_lazy_region*
+__vmm_lazy_find(uintptr_t va)
+{
+    for (uint32_t i = 0; i < vmm_lazy_count; i++) {
+        if (va >= vmm_lazy[i].start && va < vmm_lazy[i].end) {
+            return &vmm_lazy[i];
+        }
+    }
+    return NULL;
+}
+
+// 查询映射信息，但不固定所查到的物理页（仅供 vmm 内部检查映射是否存在）
+static v_mapping
+__vmm_lookup(void* va)
+{
+    assert(((uintptr_t)va & 0xFFFU) == 0);
+
+    uint32_t l1_index = L1_INDEX(va);
+    uint32_t l2_index = L2_INDEX(va);
+
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR;
+    x86_pte_t l1pte = l1pt->entry[l1_index];
+
+    v_mapping mapping = { .flags = 0, .pa = 0, .pn = 0 };
+    if (IS_LARGE_PDE(l1pte)) {
+        // 大页：物理地址为大页的起始地址加上 va 在大页内的偏移
+        mapping.flags = PG_ENTRY_FLAGS(l1pte);
+        mapping.pa = PG_LARGE_ADDR(l1pte) | ((uintptr_t)va & (PG_LARGE_SIZE - 1));
+        mapping.pn = mapping.pa >> PG_SIZE_BITS;
+    } else if (l1pte) {
+        x86_pte_t l2pte =
+          ((x86_page_table*)L2_VADDR(l1_index))->entry[l2_index];
+        if (l2pte) {
+            mapping.flags = PG_ENTRY_FLAGS(l2pte);
+            mapping.pa = PG_ENTRY_ADDR(l2pte);
+            mapping.pn = PG_ENTRY_PPN(l2pte);
+        }
+    }
+
+    return mapping;
+}
+
+// 为按需分配区域中的页 va 分配物理页，已映射时什么也不做
+static int
+__vmm_fault_in(void* va)
+{
+    struct vmm_lazy_region* region = __vmm_lazy_find((uintptr_t)va);
+    if (!region) {
+        return 0;
+    }
+    if (__vmm_lookup(va).flags & PG_PRESENT) {
+        return 1;
+    }
+    return vmm_alloc_zeroed_pages(va, PG_SIZE, region->attr);
+}
+
+int
+vmm_lazy_add(void* va, size_t sz, pt_attr tattr)
+{
+    assert(((uintptr_t)va & 0xFFFU) == 0);
+
+    if (vmm_lazy_count == VMM_LAZY_MAX) {
+        return 0;
+    }
+    vmm_lazy[vmm_lazy_count++] = (struct vmm_lazy_region){
+        .start = (uintptr_t)va,
+        .end = (uintptr_t)va + sz,
+        .attr = tattr,
+    };
+    return 1;
+}
+
+static int
+__vmm_cow_fault(void* va);
+
+int
+vmm_handle_fault(void* va, uint32_t err_code)
+{
+    // 保护违例中，只有对写时复制页的写入不是错误
+    if (err_code & PF_PRESENT) {
+        return (err_code & PF_WRITE) && __vmm_cow_fault((void*)PG_ALIGN(va));
+    }
+    return __vmm_fault_in((void*)PG_ALIGN(va)) || ioremap_fault(va);
+}
+
+int
+vmm_alloc_tables(void* va, size_t sz)
+{
+    uintptr_t end = (uintptr_t)va + sz;
+    for (uintptr_t p = (uintptr_t)va; p < end; p = (p & ~(PG_LARGE_SIZE - 1)) + PG_LARGE_SIZE) {
+        if (!__vmm_get_table(L1_INDEX(p), PG_PREM_RW)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * 写时复制
+ *
+ * vmm_clone_pd 不复制用户空间（HIGHER_HLF_BASE 之下）的页，只复制页表：
+ *  可写的页在父子两边都改为只读并打上 PG_COW，物理页的引用计数加一。
+ *  内核空间的页目录项原样复制，两边共享同一批页表。
+ * 之后任何一方写入这样的页都会引发保护违例，由 __vmm_cow_fault 处理：
+ *  引用只剩一个时直接恢复可写，否则复制出一个私有的页。
+ *  共享的大页先拆分为页表（块也拆分为独立计数的页），只复制被写入的 4KiB 页。
+ * 不受 PMM 管理的页（预留页、MMIO 等）无法计数，按原样共享。
+ */
+
+// 页目录 pd_pa 中包含一级页表第 l1_index 项的表（经由直接映射区访问），表内的索引存入 index
+static x86_page_table*
+__vmm_pd_table(void* pd_pa, uint32_t l1_index, uint32_t* index)
+{
+    x86_page_table* dir = phys_to_virt((uintptr_t)pd_pa);
+#ifdef CONFIG_PAE
+    // PAE：pd_pa 为 PDPT，其中第 i 项指向覆盖第 i 个 1GiB 的页目录
+    dir = phys_to_virt(PG_ENTRY_ADDR(dir->entry[l1_index >> PG_INDEX_BITS]));
+    l1_index &= PG_MAX_ENTRIES - 1;
+#endif
+    *index = l1_index;
+    return dir;
+}
+
+// 共享表项 e 所映射的 2^order 个物理页（起始于 pa），可写的页改为写时复制。
+// 返回父子双方都应填写的表项
+static x86_pte_t
+__vmm_share_entry(x86_pte_t e, paddr_t pa, uint32_t order)
+{
+    uintptr_t ppn = (uintptr_t)(pa >> PG_SIZE_BITS);
+    if (!IS_CACHED(e)) {
+        return e;
+    }
+    if (order ? !pmm_ref_pages((void*)(uintptr_t)pa, order) : !pmm_ref_frame(ppn)) {
+        return e;
+    }
+
+    // 页被多个地址空间共享后，内存整理无法找到全部的页表项，不再迁移它
+    struct pm_page* pp = pmm_frame(ppn);
+    pp->flags &= ~PP_FL_MOVABLE;
+
+    if (e & PG_WRITE) {
+        e = (e & ~(x86_pte_t)PG_WRITE) | PG_COW;
+    }
+    return e;
+}
+
+void*
+vmm_clone_pd()
+{
+    void* pd_pa = vmm_init_pd();
+    if (!pd_pa) {
+        return NULL;
+    }
+
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR;
+    struct vmm_gather g = { .page_count = 0, .frame_count = 0 };
+    for (uint32_t i = 0; i < PG_L1_RECURSIVE; i++) {
+        x86_pte_t l1pte = l1pt->entry[i];
+        if (!l1pte) {
+            continue;
+        }
+
+        uint32_t ci;
+        x86_page_table* child = __vmm_pd_table(pd_pa, i, &ci);
+        if (i >= L1_INDEX(HIGHER_HLF_BASE)) {
+            child->entry[ci] = l1pte;
+            continue;
+        }
+
+        if (IS_LARGE_PDE(l1pte)) {
+            // 块的引用计数记在第一个页上，块被拆分后（见 __vmm_cow_split）记在每个页上
+            x86_pte_t e = __vmm_share_entry(l1pte, PG_LARGE_ADDR(l1pte), PG_LARGE_ORDER);
+            child->entry[ci] = e;
+            if (e != l1pte) {
+                l1pt->entry[i] = e;
+                __vmm_gather_page(&g, (void*)V_ADDR(i, 0, 0));
+            }
+            continue;
+        }
+
+        void* pt_pa = __vmm_alloc_table();
+        if (!pt_pa) {
+            __vmm_gather_flush(&g);
+            vmm_destroy_pd(pd_pa);
+            return NULL;
+        }
+        child->entry[ci] = PG_ENTRY_FLAGS(l1pte) | NEW_L2_ENTRY_PA(0, (uintptr_t)pt_pa);
+
+        x86_page_table* l2pt = (x86_page_table*)L2_VADDR(i);
+        x86_page_table* child_pt = phys_to_virt((uintptr_t)pt_pa);
+        for (uint32_t j = 0; j < PG_MAX_ENTRIES; j++) {
+            x86_pte_t l2pte = l2pt->entry[j];
+            if (!l2pte) {
+                continue;
+            }
+            x86_pte_t e = __vmm_share_entry(l2pte, PG_ENTRY_ADDR(l2pte), 0);
+            child_pt->entry[j] = e;
+            if (e != l2pte) {
+                l2pt->entry[j] = e;
+                __vmm_gather_page(&g, (void*)V_ADDR(i, j, 0));
+            }
+        }
+    }
+
+    // 父进程中被改为只读的页
+    __vmm_gather_flush(&g);
+    return pd_pa;
+}
+
+void
+vmm_destroy_pd(void* pd_pa)
+{
+    // 用户空间的页与页表归这个页目录所有，内核空间的页表是共享的
+    for (uint32_t i = 0; i < L1_INDEX(HIGHER_HLF_BASE); i++) {
+        uint32_t ci;
+        x86_pte_t l1pte = __vmm_pd_table(pd_pa, i, &ci)->entry[ci];
+        if (!l1pte) {
+            continue;
+        }
+
+        if (IS_LARGE_PDE(l1pte)) {
+            pmm_free_pages((void*)(uintptr_t)PG_LARGE_ADDR(l1pte), PG_LARGE_ORDER);
+            continue;
+        }
+
+        x86_page_table* pt = phys_to_virt(PG_ENTRY_ADDR(l1pte));
+        for (uint32_t j = 0; j < PG_MAX_ENTRIES; j++) {
+            if (IS_CACHED(pt->entry[j])) {
+                pmm_free_frame(PG_ENTRY_PPN(pt->entry[j]));
+            }
+        }
+        pmm_free_frame(PG_ENTRY_PPN(l1pte));
+    }
+
+#ifdef CONFIG_PAE
+    x86_page_table* pdpt = phys_to_virt((uintptr_t)pd_pa);
+    for (uint32_t i = 0; i < PG_L1_TABLES; i++) {
+        pmm_free_frame(PG_ENTRY_PPN(pdpt->entry[i]));
+    }
+#endif
+    pmm_free_page(pd_pa);
+}
+
+// 把一级页表第 l1_index 项（写时复制的大页 e）拆分为一个页表，其中的页表项引用原来的块，
+//  块也随之拆分为独立计数的页。此后写入只需复制被写入的那个 4KiB 页
+static int
+__vmm_cow_split(uint32_t l1_index, x86_pte_t e)
+{
+    paddr_t pa = PG_LARGE_ADDR(e);
+    void* pt_pa = __vmm_alloc_table();
+    if (!pt_pa) {
+        return 0;
+    }
+    if (!pmm_split_pages((void*)(uintptr_t)pa, PG_LARGE_ORDER)) {
+        pmm_free_page(pt_pa);
+        return 0;
+    }
+
+    // 每个页沿用大页的属性，PAT 位移回 4KiB 页表项中的位置
+    x86_pte_t flags = PG_ENTRY_FLAGS(e) & ~(x86_pte_t)PG_PDE_4MB;
+    if (e & PG_LARGE_PAT) {
+        flags |= PG_PAT;
+    }
+    x86_page_table* pt = phys_to_virt((uintptr_t)pt_pa);
+    for (uint32_t i = 0; i < PG_MAX_ENTRIES; i++) {
+        pt->entry[i] = NEW_L2_ENTRY_PA(flags, pa + ((paddr_t)i << PG_SIZE_BITS));
+    }
+
+    // 页目录项总是可写的，读写权限由页表项决定
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR;
+    l1pt->entry[l1_index] = NEW_L1_ENTRY(PG_PREM_RW | (e & PG_ALLOW_USER), pt_pa);
+    cpu_invplg((void*)V_ADDR(l1_index, 0, 0));
+    return 1;
+}
+
+static int
+__vmm_cow_fault(void* va)
+{
+    uint32_t l1_index = L1_INDEX(va);
+    if (l1_index >= PG_L1_RECURSIVE) {
+        return 0;
+    }
+
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR;
+    x86_pte_t l1pte = l1pt->entry[l1_index];
+    if (!l1pte) {
+        return 0;
+    }
+    if (IS_LARGE_PDE(l1pte)) {
+        if (!IS_CACHED(l1pte) || !(l1pte & PG_COW)) {
+            return 0;
+        }
+
+        // 其他地址空间都已不再引用这个块，不必复制。块被拆分后，其中的页可能各有不同的
+        //  引用者，只能逐页处理
+        struct pm_page* pp = pmm_frame((uintptr_t)(PG_LARGE_ADDR(l1pte) >> PG_SIZE_BITS));
+        if (pp && (pp->flags & PP_FL_BLOCK_HEAD) && pp->ref_count == 1) {
+            l1pt->entry[l1_index] = (l1pte & ~(x86_pte_t)PG_COW) | PG_WRITE;
+            cpu_invplg(va);
+            return 1;
+        }
+
+        // 为一次写入复制整个大页既慢，又需要一个物理连续的块，改为拆分后只复制一个页
+        if (!__vmm_cow_split(l1_index, l1pte)) {
+            return 0;
+        }
+    }
+
+    x86_page_table* table = (x86_page_table*)L2_VADDR(l1_index);
+    uint32_t index = L2_INDEX(va);
+    x86_pte_t e = table->entry[index];
+    if (!IS_CACHED(e) || !(e & PG_COW)) {
+        return 0;
+    }
+
+    // 其他地址空间都已不再引用这个页（写入过或已销毁），不必复制
+    x86_pte_t flags = (PG_ENTRY_FLAGS(e) & ~(x86_pte_t)PG_COW) | PG_WRITE;
+    struct pm_page* pp = pmm_frame(PG_ENTRY_PPN(e));
+    if (pp && pp->ref_count == 1) {
+        table->entry[index] = PG_ENTRY_ADDR(e) | flags;
+        cpu_invplg(va);
+        return 1;
+    }
+
+    // 新页取自直接映射区，复制时无需临时映射
+    void* copy = pmm_alloc_page_zone(ZONE_NORMAL);
+    if (!copy) {
+        return 0;
+    }
+    memcpy(phys_to_virt((uintptr_t)copy), va, PG_SIZE);
+
+    table->entry[index] = NEW_L2_ENTRY_PA(flags, (uintptr_t)copy);
+    cpu_invplg(va);
+
+    // 放弃对原页的引用
+    pmm_free_frame(PG_ENTRY_PPN(e));
+    return 1;
+}
+
 //若映射不存在则设置新的映射，否则忽略操作
 void
 vmm_set_mapping(void* va, void* pa, pt_attr attr) {
@@ -251,7 +1113,7 @@ vmm_set_mapping(void* va, void* pa, pt_attr attr) {
     uint32_t l2_index = L2_INDEX(va);
 
     // prevent map of recursive mapping region
-    if (l1_index == 1023) {
+    if (l1_index >= PG_L1_RECURSIVE) {
         return;
     }
     
@@ -268,48 +1130,89 @@ vmm_unmap_page(void* va)
     uint32_t l2_index = L2_INDEX(va);
 
     // prevent unmap of recursive mapping region
-    if (l1_index == 1023) {
+    if (l1_index >= PG_L1_RECURSIVE) {
         return;
     }
 
-    x86_page_table* l1pt = (x86_page_table*)L1_BASE_VADDR;
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR;
 
     x86_pte_t l1pte = l1pt->entry[l1_index];
 
+    // 大页只能整体解除映射，va 须为大页的起始地址
+    if (IS_LARGE_PDE(l1pte)) {
+        if (!((uintptr_t)va & (PG_LARGE_SIZE - 1))) {
+            __vmm_unmap_large(l1_index, true);
+        }
+        return;
+    }
+
     if (l1pte) {
         x86_page_table* l2pt = (x86_page_table*)L2_VADDR(l1_index);
         x86_pte_t l2pte = l2pt->entry[l2_index];
+        // 先清除页表项并刷新 TLB，再释放物理页
+        l2pt->entry[l2_index] = PTE_NULL;
+        cpu_invplg(va);
         if (IS_CACHED(l2pte)) {
-            pmm_free_page((void*)l2pte);
+            pmm_free_frame(PG_ENTRY_PPN(l2pte));
         }
-        cpu_invplg(va);
-        l2pt->entry[l2_index] = PTE_NULL;
+        __vmm_release_alt(va, l2pte);
     }
 }
 
-//查询给定虚拟地址的映射信息
-v_mapping
-vmm_lookup(void* va)
+void*
+vmm_mount_page(void* va, void* pa)
 {
-    assert(((uintptr_t)va & 0xFFFU) == 0);
+    assert(((uintptr_t)va & 0xFFFU) == 0) assert(((uintptr_t)pa & 0xFFFU) == 0);
 
     uint32_t l1_index = L1_INDEX(va);
     uint32_t l2_index = L2_INDEX(va);
 
-    x86_page_table* l1pt = (x86_page_table*)L1_BASE_VADDR;
-    x86_pte_t l1pte = l1pt->entry[l1_index];
+    // 挂载不应分配页表（分配页表本身可能需要挂载），窗口所在的页表必须已经存在
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR;
+    if (l1_index >= PG_L1_RECURSIVE || !l1pt->entry[l1_index] ||
+        IS_LARGE_PDE(l1pt->entry[l1_index])) {
+        return NULL;
+    }
 
-    v_mapping mapping = { .flags = 0, .pa = 0, .pn = 0 };
-    if (l1pte) {
-        x86_pte_t l2pte =
-          ((x86_page_table*)L2_VADDR(l1_index))->entry[l2_index];
-        if (l2pte) {
-            mapping.flags = PG_ENTRY_FLAGS(l2pte);
-            mapping.pa = PG_ENTRY_ADDR(l2pte);
-            mapping.pn = mapping.pa >> PG_SIZE_BITS;
-        }
+    x86_page_table* l2pt = (x86_page_table*)L2_VADDR(l1_index);
+    l2pt->entry[l2_index] = NEW_L2_ENTRY(__vmm_leaf_attr(l1_index, PG_PREM_RW), pa);
+    cpu_invplg(va);
+    __vmm_pin_frame((uintptr_t)pa >> PG_SIZE_BITS);
+
+    return va;
+}
+
+void
+vmm_unmount_page(void* va)
+{
+    assert(((uintptr_t)va & 0xFFFU) == 0);
+
+    uint32_t l1_index = L1_INDEX(va);
+    uint32_t l2_index = L2_INDEX(va);
+
+    x86_page_dir* l1pt = (x86_page_dir*)L1_BASE_VADDR;
+    if (l1_index >= PG_L1_RECURSIVE || !l1pt->entry[l1_index] ||
+        IS_LARGE_PDE(l1pt->entry[l1_index])) {
+        return;
     }
 
+    // 与 vmm_unmap_page 不同，被挂载的物理页不归我们所有，不释放
+    x86_page_table* l2pt = (x86_page_table*)L2_VADDR(l1_index);
+    x86_pte_t l2pte = l2pt->entry[l2_index];
+    l2pt->entry[l2_index] = PTE_NULL;
+    cpu_invplg(va);
+    __vmm_release_alt(va, l2pte);
+}
+
+//查询给定虚拟地址的映射信息
+//  调用者拿到了物理地址，该页从此不再参与内存整理
+v_mapping
+vmm_lookup(void* va)
+{
+    v_mapping mapping = __vmm_lookup(va);
+    if (mapping.flags & PG_PRESENT) {
+        __vmm_pin_frame(mapping.pn);
+    }
     return mapping;
 }
 
@@ -317,5 +1220,5 @@ vmm_lookup(void* va)
 void*
 vmm_v2p(void* va)
 {
-    return (void*)vmm_lookup(va).pa;
+    return (void*)(uintptr_t)vmm_lookup(va).pa;
 }